@@ -15,6 +15,7 @@
 #include <linux/moduleloader.h>
 #include <linux/netdevice.h>
 #include <linux/string.h>
+#include <net/netlink.h>
 #include <linux/slab.h>
 #include <asm/cacheflush.h>
 #include <asm/hwcap.h>
@@ -71,36 +72,102 @@ struct jit_ctx {
 
 int bpf_jit_enable __read_mostly;
 
-static u64 jit_get_skb_b(struct sk_buff *skb, unsigned offset)
+/*
+ * Negative offsets (SKF_NET_OFF, SKF_LL_OFF) never pass the headlen check
+ * of the fast path, so they always end up here, as in load_pointer().
+ */
+static int jit_copy_bits(const struct sk_buff *skb, int offset, void *to,
+			 int len)
+{
+	void *ptr;
+
+	if (offset >= 0)
+		return skb_copy_bits(skb, offset, to, len);
+
+	ptr = bpf_internal_load_pointer_neg_helper(skb, offset, len);
+	if (ptr == NULL)
+		return -EFAULT;
+
+	memcpy(to, ptr, len);
+	return 0;
+}
+
+static u64 jit_get_skb_b(struct sk_buff *skb, int offset)
 {
 	u8 ret;
 	int err;
 
-	err = skb_copy_bits(skb, offset, &ret, 1);
+	err = jit_copy_bits(skb, offset, &ret, 1);
 
 	return (u64)err << 32 | ret;
 }
 
-static u64 jit_get_skb_h(struct sk_buff *skb, unsigned offset)
+static u64 jit_get_skb_h(struct sk_buff *skb, int offset)
 {
 	u16 ret;
 	int err;
 
-	err = skb_copy_bits(skb, offset, &ret, 2);
+	err = jit_copy_bits(skb, offset, &ret, 2);
 
 	return (u64)err << 32 | ntohs(ret);
 }
 
-static u64 jit_get_skb_w(struct sk_buff *skb, unsigned offset)
+static u64 jit_get_skb_w(struct sk_buff *skb, int offset)
 {
 	u32 ret;
 	int err;
 
-	err = skb_copy_bits(skb, offset, &ret, 4);
+	err = jit_copy_bits(skb, offset, &ret, 4);
 
 	return (u64)err << 32 | ntohl(ret);
 }
 
+/*
+ * The netlink attribute lookups mirror sk_run_filter(): a non-zero upper
+ * word makes the filter return 0.
+ */
+static u64 jit_anc_nlattr(struct sk_buff *skb, u32 A, u32 X)
+{
+	struct nlattr *nla;
+
+	if (skb_is_nonlinear(skb))
+		return 1ULL << 32;
+	if (skb->len < sizeof(struct nlattr))
+		return 1ULL << 32;
+	if (A > skb->len - sizeof(struct nlattr))
+		return 1ULL << 32;
+
+	nla = nla_find((struct nlattr *)&skb->data[A], skb->len - A, X);
+
+	return nla ? (void *)nla - (void *)skb->data : 0;
+}
+
+static u64 jit_anc_nlattr_nest(struct sk_buff *skb, u32 A, u32 X)
+{
+	struct nlattr *nla;
+
+	if (skb_is_nonlinear(skb))
+		return 1ULL << 32;
+	if (skb->len < sizeof(struct nlattr))
+		return 1ULL << 32;
+	if (A > skb->len - sizeof(struct nlattr))
+		return 1ULL << 32;
+
+	nla = (struct nlattr *)&skb->data[A];
+	if (nla->nla_len > skb->len - A)
+		return 1ULL << 32;
+
+	nla = nla_find_nested(nla, X);
+
+	return nla ? (void *)nla - (void *)skb->data : 0;
+}
+
+#ifdef __BIG_ENDIAN_BITFIELD
+#define PKT_TYPE_MAX	(7 << 5)
+#else
+#define PKT_TYPE_MAX	7
+#endif
+
 /*
  * Wrapper that handles both OABI and EABI and assures Thumb2 interworking
  * (where the assembly routines like __aeabi_uidiv could cause problems).
@@ -169,6 +236,8 @@ static inline bool is_load_to_a(u16 inst)
 	case BPF_S_ANC_PROTOCOL:
 	case BPF_S_ANC_RXHASH:
 	case BPF_S_ANC_QUEUE:
+	case BPF_S_ANC_PKTTYPE:
+	case BPF_S_ANC_HATYPE:
 		return true;
 	default:
 		return false;
@@ -463,6 +532,7 @@ static int build_body(struct jit_ctx *ctx)
 	const struct sock_filter *inst;
 	unsigned i, load_order, off, condt;
 	int imm12;
+	void *anc_func;
 	u32 k;
 
 	for (i = 0; i < prog->len; i++) {
@@ -498,17 +568,20 @@ static int build_body(struct jit_ctx *ctx)
 		case BPF_S_LD_B_ABS:
 			load_order = 0;
 load:
-			/* the interpreter will deal with the negative K */
-			if ((int)k < 0)
-				return -ENOTSUPP;
+			/* a negative K is handled on the slowpath */
 			emit_mov_i(r_off, k, ctx);
 load_common:
 			ctx->seen |= SEEN_DATA | SEEN_CALL;
 
 			if (load_order > 0) {
-				emit(ARM_SUB_I(r_scratch, r_skb_hl,
-					       1 << load_order), ctx);
-				emit(ARM_CMP_R(r_scratch, r_off), ctx);
+				/*
+				 * headlen - size must not wrap, or any
+				 * offset would pass the check below
+				 */
+				emit(ARM_SUBS_I(r_scratch, r_skb_hl,
+						1 << load_order), ctx);
+				_emit(ARM_COND_HS, ARM_CMP_R(r_scratch, r_off),
+				      ctx);
 				condt = ARM_COND_HS;
 			} else {
 				emit(ARM_CMP_R(r_skb_hl, r_off), ctx);
@@ -565,9 +638,6 @@ load_ind:
 		case BPF_S_LDX_B_MSH:
 			/* x = ((*(frame + k)) & 0xf) << 2; */
 			ctx->seen |= SEEN_X | SEEN_DATA | SEEN_CALL;
-			/* the interpreter should deal with the negative K */
-			if (k < 0)
-				return -1;
 			/* offset in r1: we might have to take the slow path */
 			emit_mov_i(r_off, k, ctx);
 			emit(ARM_CMP_R(r_skb_hl, r_off), ctx);
@@ -655,8 +725,12 @@ load_ind:
 			emit(ARM_AND_R(r_A, r_A, r_X), ctx);
 			break;
 		case BPF_S_ALU_LSH_K:
-			if (unlikely(k > 31))
-				return -1;
+			if (unlikely(k > 31)) {
+				/* shift by register, as the interpreter does */
+				emit_mov_i(r_scratch, k, ctx);
+				emit(ARM_LSL_R(r_A, r_A, r_scratch), ctx);
+				break;
+			}
 			emit(ARM_LSL_I(r_A, r_A, k), ctx);
 			break;
 		case BPF_S_ALU_LSH_X:
@@ -664,8 +738,11 @@ load_ind:
 			emit(ARM_LSL_R(r_A, r_A, r_X), ctx);
 			break;
 		case BPF_S_ALU_RSH_K:
-			if (unlikely(k > 31))
-				return -1;
+			if (unlikely(k > 31)) {
+				emit_mov_i(r_scratch, k, ctx);
+				emit(ARM_LSR_R(r_A, r_A, r_scratch), ctx);
+				break;
+			}
 			emit(ARM_LSR_I(r_A, r_A, k), ctx);
 			break;
 		case BPF_S_ALU_RSH_X:
@@ -814,6 +891,54 @@ b_epilogue:
 			off = offsetof(struct sk_buff, queue_mapping);
 			emit(ARM_LDRH_I(r_A, r_skb, off), ctx);
 			break;
+		case BPF_S_ANC_PKTTYPE:
+			/* A = skb->pkt_type */
+			ctx->seen |= SEEN_SKB;
+			BUILD_BUG_ON(offsetof(struct sk_buff,
+					      __pkt_type_offset) > 0xfff);
+			off = offsetof(struct sk_buff, __pkt_type_offset);
+			emit(ARM_LDRB_I(r_A, r_skb, off), ctx);
+			emit(ARM_AND_I(r_A, r_A, PKT_TYPE_MAX), ctx);
+#ifdef __BIG_ENDIAN_BITFIELD
+			emit(ARM_LSR_I(r_A, r_A, 5), ctx);
+#endif
+			break;
+		case BPF_S_ANC_HATYPE:
+			/* A = skb->dev->type */
+			ctx->seen |= SEEN_SKB;
+			off = offsetof(struct sk_buff, dev);
+			emit(ARM_LDR_I(r_scratch, r_skb, off), ctx);
+
+			emit(ARM_CMP_I(r_scratch, 0), ctx);
+			emit_err_ret(ARM_COND_EQ, ctx);
+
+			BUILD_BUG_ON(FIELD_SIZEOF(struct net_device,
+						  type) != 2);
+			/* too far for the 8-bit LDRH offset */
+			off = offsetof(struct net_device, type);
+			emit_mov_i(r_off, off, ctx);
+			emit(ARM_ADD_R(r_scratch, r_scratch, r_off), ctx);
+			emit(ARM_LDRH_I(r_A, r_scratch, 0), ctx);
+			break;
+		case BPF_S_ANC_NLATTR:
+			anc_func = jit_anc_nlattr;
+			goto anc_call;
+		case BPF_S_ANC_NLATTR_NEST:
+			anc_func = jit_anc_nlattr_nest;
+anc_call:
+			/* A = func(skb, A, X) */
+			update_on_xread(ctx);
+			ctx->seen |= SEEN_SKB | SEEN_CALL;
+			emit(ARM_MOV_R(ARM_R0, r_skb), ctx);
+			emit(ARM_MOV_R(ARM_R1, r_A), ctx);
+			emit(ARM_MOV_R(ARM_R2, r_X), ctx);
+			emit_mov_i(ARM_R3, (u32)anc_func, ctx);
+			emit_blx_r(ARM_R3, ctx);
+			/* a non-zero upper word means "return 0" */
+			emit(ARM_CMP_I(ARM_R1, 0), ctx);
+			emit_err_ret(ARM_COND_NE, ctx);
+			emit(ARM_MOV_R(r_A, ARM_R0), ctx);
+			break;
 		default:
 			return -1;
 		}
@@ -143,6 +143,7 @@ void blk_rq_init(struct request_queue *q, struct request *rq)
 	rq->tag = -1;
 	rq->ref_count = 1;
 	rq->start_time = jiffies;
+	rq->start_ktime = ktime_get();
 	set_start_time_ns(rq);
 	rq->part = NULL;
 }
@@ -1892,6 +1893,10 @@ static void blk_account_io_done(struct request *req)
 
 		hd_struct_put(part);
 		part_stat_unlock();
+
+		if (rw == READ)
+			bdi_account_read_latency(&req->q->backing_dev_info,
+				ktime_us_delta(ktime_get(), req->start_ktime));
 	}
 }
 
@@ -24,6 +24,7 @@
 #include <linux/wait.h>
 #include <linux/async.h>
 #include <linux/pm_runtime.h>
+#include <linux/boot_timeline.h>
 
 #include "base.h"
 #include "power/power.h"
@@ -152,12 +153,17 @@ static void driver_deferred_probe_trigger(void)
  * Instead, this initcall makes sure that deferred probing is delayed until
  * late_initcall time.
  */
+static LIST_HEAD(async_probe_domain);
+
 static int deferred_probe_initcall(void)
 {
 	deferred_wq = create_singlethread_workqueue("deferwq");
 	if (WARN_ON(!deferred_wq))
 		return -ENOMEM;
 
+	/* Let async probes queue their deferrals before retrying them */
+	async_synchronize_full_domain(&async_probe_domain);
+
 	driver_deferred_probe_enable = true;
 	driver_deferred_probe_trigger();
 	/* Sort as many dependencies as possible before exiting initcalls */
@@ -251,8 +257,13 @@ static DECLARE_WAIT_QUEUE_HEAD(probe_waitqueue);
 
 static int really_probe(struct device *dev, struct device_driver *drv)
 {
+	bool timeline = boot_timeline_enabled();
+	ktime_t uninitialized_var(start);
 	int ret = 0;
 
+	if (timeline)
+		start = ktime_get();
+
 	atomic_inc(&probe_count);
 	pr_debug("bus: '%s': %s: probing driver %s with device %s\n",
 		 drv->bus->name, __func__, drv->name, dev_name(dev));
@@ -305,6 +316,8 @@ probe_failed:
 	 */
 	ret = 0;
 done:
+	if (timeline)
+		boot_timeline_record("probe", dev_name(dev), start, ret);
 	atomic_dec(&probe_count);
 	wake_up(&probe_waitqueue);
 	return ret;
@@ -416,6 +429,28 @@ out_unlock:
 }
 EXPORT_SYMBOL_GPL(device_attach);
 
+static void driver_attach_device(struct device_driver *drv, struct device *dev)
+{
+	if (dev->parent)	/* Needed for USB */
+		device_lock(dev->parent);
+	device_lock(dev);
+	if (!dev->driver)
+		driver_probe_device(drv, dev);
+	device_unlock(dev);
+	if (dev->parent)
+		device_unlock(dev->parent);
+}
+
+static void __driver_attach_async(void *data, async_cookie_t cookie)
+{
+	struct device *dev = data;
+
+	driver_attach_device(dev->p->async_driver, dev);
+	put_device(dev);
+	atomic_dec(&probe_count);
+	wake_up(&probe_waitqueue);
+}
+
 static int __driver_attach(struct device *dev, void *data)
 {
 	struct device_driver *drv = data;
@@ -433,15 +468,21 @@ static int __driver_attach(struct device *dev, void *data)
 	if (!driver_match_device(drv, dev))
 		return 0;
 
-	if (dev->parent)	/* Needed for USB */
-		device_lock(dev->parent);
-	device_lock(dev);
-	if (!dev->driver)
-		driver_probe_device(drv, dev);
-	device_unlock(dev);
-	if (dev->parent)
-		device_unlock(dev->parent);
+	if (drv->probe_async) {
+		/*
+		 * The probe is counted until it has run so that
+		 * wait_for_device_probe() and driver_probe_done() see it.
+		 * The driver can't go away meanwhile: driver_unregister()
+		 * waits for the async probes in driver_detach().
+		 */
+		atomic_inc(&probe_count);
+		dev->p->async_driver = drv;
+		async_schedule_domain(__driver_attach_async, get_device(dev),
+				      &async_probe_domain);
+		return 0;
+	}
 
+	driver_attach_device(drv, dev);
 	return 0;
 }
 
@@ -525,6 +566,9 @@ void driver_detach(struct device_driver *drv)
 	struct device_private *dev_prv;
 	struct device *dev;
 
+	if (drv->probe_async)
+		async_synchronize_full_domain(&async_probe_domain);
+
 	for (;;) {
 		spin_lock(&drv->p->klist_devices.k_lock);
 		if (list_empty(&drv->p->klist_devices.k_list)) {
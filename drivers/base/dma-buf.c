@@ -27,9 +27,25 @@
 #include <linux/dma-buf.h>
 #include <linux/anon_inodes.h>
 #include <linux/export.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 
 static inline int is_dma_buf_file(struct file *);
 
+/*
+ * Map/unmap call counts and time spent in the exporters' map_dma_buf and
+ * unmap_dma_buf, shown in debugfs.
+ */
+static struct {
+	atomic_t	map_calls;
+	atomic_t	map_errors;
+	atomic_t	unmap_calls;
+	atomic64_t	map_ns;
+	atomic64_t	unmap_ns;
+} dma_buf_stats;
+
 static int dma_buf_release(struct inode *inode, struct file *file)
 {
 	struct dma_buf *dmabuf;
@@ -273,13 +289,21 @@ struct sg_table *dma_buf_map_attachment(struct dma_buf_attachment *attach,
 					enum dma_data_direction direction)
 {
 	struct sg_table *sg_table = ERR_PTR(-EINVAL);
+	ktime_t start;
 
 	might_sleep();
 
 	if (WARN_ON(!attach || !attach->dmabuf))
 		return ERR_PTR(-EINVAL);
 
+	start = ktime_get();
 	sg_table = attach->dmabuf->ops->map_dma_buf(attach, direction);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &dma_buf_stats.map_ns);
+
+	atomic_inc(&dma_buf_stats.map_calls);
+	if (IS_ERR_OR_NULL(sg_table))
+		atomic_inc(&dma_buf_stats.map_errors);
 
 	return sg_table;
 }
@@ -298,11 +322,17 @@ void dma_buf_unmap_attachment(struct dma_buf_attachment *attach,
 				struct sg_table *sg_table,
 				enum dma_data_direction direction)
 {
+	ktime_t start;
+
 	if (WARN_ON(!attach || !attach->dmabuf || !sg_table))
 		return;
 
+	start = ktime_get();
 	attach->dmabuf->ops->unmap_dma_buf(attach, sg_table,
 						direction);
+	atomic64_add(ktime_to_ns(ktime_sub(ktime_get(), start)),
+		     &dma_buf_stats.unmap_ns);
+	atomic_inc(&dma_buf_stats.unmap_calls);
 }
 EXPORT_SYMBOL_GPL(dma_buf_unmap_attachment);
 
@@ -504,3 +534,40 @@ void dma_buf_vunmap(struct dma_buf *dmabuf, void *vaddr)
 		dmabuf->ops->vunmap(dmabuf, vaddr);
 }
 EXPORT_SYMBOL_GPL(dma_buf_vunmap);
+
+#ifdef CONFIG_DEBUG_FS
+static int dma_buf_debugfs_show(struct seq_file *s, void *unused)
+{
+	seq_printf(s, "map calls:   %d (%d failed)\n",
+		   atomic_read(&dma_buf_stats.map_calls),
+		   atomic_read(&dma_buf_stats.map_errors));
+	seq_printf(s, "map time:    %llu us\n",
+		   div_u64(atomic64_read(&dma_buf_stats.map_ns), NSEC_PER_USEC));
+	seq_printf(s, "unmap calls: %d\n",
+		   atomic_read(&dma_buf_stats.unmap_calls));
+	seq_printf(s, "unmap time:  %llu us\n",
+		   div_u64(atomic64_read(&dma_buf_stats.unmap_ns),
+			   NSEC_PER_USEC));
+	return 0;
+}
+
+static int dma_buf_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dma_buf_debugfs_show, inode->i_private);
+}
+
+static const struct file_operations dma_buf_debugfs_fops = {
+	.open           = dma_buf_debugfs_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
+static __init int dma_buf_debugfs_init(void)
+{
+	debugfs_create_file("dma_buf", S_IRUGO, NULL, NULL,
+			    &dma_buf_debugfs_fops);
+	return 0;
+}
+late_initcall(dma_buf_debugfs_init);
+#endif
@@ -23,12 +23,17 @@
 #include <asm/dma-contiguous.h>
 
 #include <linux/memblock.h>
+#include <linux/debugfs.h>
 #include <linux/err.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
 #include <linux/mm.h>
 #include <linux/mutex.h>
 #include <linux/page-isolation.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/swap.h>
+#include <linux/wait.h>
 #include <linux/mm_types.h>
 #include <linux/dma-contiguous.h>
 
@@ -36,10 +41,40 @@
 #define SZ_1M (1 << 20)
 #endif
 
+/*
+ * alloc_contig_range() isolates whole blocks of this order around the
+ * requested range, so two allocations may only run concurrently if they
+ * touch different blocks.  Areas are aligned to this order as well.
+ */
+#define CMA_ISOLATE_ORDER	max(MAX_ORDER - 1, pageblock_order)
+
+/* Busy ranges and isolation waits tolerated before an allocation fails. */
+#define CMA_MAX_RETRIES		16
+
+struct cma_stats {
+	unsigned long	allocs;
+	unsigned long	failures;
+	unsigned long	busy_retries;
+	unsigned long	isolate_waits;
+	u64		total_ns;
+	u64		max_ns;
+};
+
+/*
+ * @bitmap marks pages that are allocated or reserved by an allocation in
+ * progress, @isolating marks CMA_ISOLATE_ORDER blocks whose pageblocks are
+ * being isolated.  Both are protected by @lock, which is only held for
+ * bitmap updates; page migration runs without it.
+ */
 struct cma {
 	unsigned long	base_pfn;
 	unsigned long	count;
 	unsigned long	*bitmap;
+	unsigned long	*isolating;
+	struct mutex	lock;
+	wait_queue_head_t	wait;
+	unsigned long	isolate_seq;
+	struct cma_stats	stats;
 };
 
 struct cma *dma_contiguous_default_area;
@@ -135,7 +170,8 @@ void __init dma_contiguous_reserve(phys_addr_t limit)
 	}
 };
 
-static DEFINE_MUTEX(cma_mutex);
+static struct cma *cma_areas[MAX_CMA_AREAS];
+static unsigned cma_area_count;
 
 static __init int cma_activate_area(unsigned long base_pfn, unsigned long count)
 {
@@ -163,32 +199,37 @@ static __init struct cma *cma_create_area(unsigned long base_pfn,
 				     unsigned long count)
 {
 	int bitmap_size = BITS_TO_LONGS(count) * sizeof(long);
+	int isolating_size = BITS_TO_LONGS(count >> CMA_ISOLATE_ORDER) *
+			     sizeof(long);
 	struct cma *cma;
 	int ret = -ENOMEM;
 
 	pr_debug("%s(base %08lx, count %lx)\n", __func__, base_pfn, count);
 
-	cma = kmalloc(sizeof *cma, GFP_KERNEL);
+	cma = kzalloc(sizeof *cma, GFP_KERNEL);
 	if (!cma)
 		return ERR_PTR(-ENOMEM);
 
 	cma->base_pfn = base_pfn;
 	cma->count = count;
+	mutex_init(&cma->lock);
+	init_waitqueue_head(&cma->wait);
 	cma->bitmap = kzalloc(bitmap_size, GFP_KERNEL);
+	cma->isolating = kzalloc(isolating_size, GFP_KERNEL);
 
-	if (!cma->bitmap)
-		goto no_mem;
+	if (!cma->bitmap || !cma->isolating)
+		goto err;
 
 	ret = cma_activate_area(base_pfn, count);
 	if (ret)
-		goto error;
+		goto err;
 
 	pr_debug("%s: returned %p\n", __func__, (void *)cma);
 	return cma;
 
-error:
+err:
+	kfree(cma->isolating);
 	kfree(cma->bitmap);
-no_mem:
 	kfree(cma);
 	return ERR_PTR(ret);
 }
@@ -211,8 +252,10 @@ static int __init cma_init_reserved_areas(void)
 		struct cma *cma;
 		cma = cma_create_area(PFN_DOWN(r->start),
 				      r->size >> PAGE_SHIFT);
-		if (!IS_ERR(cma))
+		if (!IS_ERR(cma)) {
 			dev_set_cma_area(r->dev, cma);
+			cma_areas[cma_area_count++] = cma;
+		}
 	}
 	return 0;
 }
@@ -299,6 +342,39 @@ err:
 	return base;
 }
 
+/* Isolation blocks touched by allocating [pageno, pageno + count). */
+static void cma_isolate_blocks(unsigned long pageno, int count,
+			       unsigned long *first, unsigned long *nr)
+{
+	*first = pageno >> CMA_ISOLATE_ORDER;
+	*nr = ((pageno + count - 1) >> CMA_ISOLATE_ORDER) - *first + 1;
+}
+
+/* Called with cma->lock held; drops it while waiting. */
+static void cma_wait_isolation(struct cma *cma)
+{
+	unsigned long seq = cma->isolate_seq;
+
+	cma->stats.isolate_waits++;
+	mutex_unlock(&cma->lock);
+	wait_event(cma->wait, ACCESS_ONCE(cma->isolate_seq) != seq);
+	mutex_lock(&cma->lock);
+}
+
+/* Called with cma->lock held. */
+static void cma_account(struct cma *cma, bool success, ktime_t start)
+{
+	u64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	if (success)
+		cma->stats.allocs++;
+	else
+		cma->stats.failures++;
+	cma->stats.total_ns += ns;
+	if (ns > cma->stats.max_ns)
+		cma->stats.max_ns = ns;
+}
+
 /**
  * dma_alloc_from_contiguous() - allocate pages from contiguous area
  * @dev:   Pointer to device for which the allocation is performed.
@@ -309,13 +385,21 @@ err:
  * device specific contiguous memory area if available or the default
  * global one. Requires architecture specific get_dev_cma_area() helper
  * function.
+ *
+ * The range is reserved in the area's bitmap before its pages are
+ * migrated, so allocations from different parts of an area proceed
+ * concurrently.
  */
 struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 				       unsigned int align)
 {
-	unsigned long mask, pfn, pageno, start = 0;
+	unsigned long mask, pfn, pageno, start = 0, resume = 0;
+	unsigned long first, nr, busy;
 	struct cma *cma = dev_get_cma_area(dev);
 	struct page *page = NULL;
+	bool blocked = false;
+	int retries = 0;
+	ktime_t begin;
 	int ret;
 
 	if (!cma || !cma->count)
@@ -331,31 +415,69 @@ struct page *dma_alloc_from_contiguous(struct device *dev, int count,
 		return NULL;
 
 	mask = (1 << align) - 1;
+	begin = ktime_get();
 
-	mutex_lock(&cma_mutex);
+	mutex_lock(&cma->lock);
 
 	for (;;) {
 		pageno = bitmap_find_next_zero_area(cma->bitmap, cma->count,
 						    start, count, mask);
-		if (pageno >= cma->count)
-			break;
+		if (pageno >= cma->count) {
+			if (!blocked)
+				break;
+			/*
+			 * Every free range left shares a block with an
+			 * allocation still migrating pages; wait for one to
+			 * finish and rescan from the first range that was
+			 * skipped, not from the start of the area.
+			 */
+			if (++retries > CMA_MAX_RETRIES)
+				break;
+			cma_wait_isolation(cma);
+			blocked = false;
+			start = resume;
+			continue;
+		}
+
+		cma_isolate_blocks(pageno, count, &first, &nr);
+		busy = find_next_bit(cma->isolating, first + nr, first);
+		if (busy < first + nr) {
+			if (!blocked)
+				resume = pageno;
+			blocked = true;
+			start = (busy + 1) << CMA_ISOLATE_ORDER;
+			continue;
+		}
+
+		bitmap_set(cma->bitmap, pageno, count);
+		bitmap_set(cma->isolating, first, nr);
+		mutex_unlock(&cma->lock);
 
 		pfn = cma->base_pfn + pageno;
 		ret = alloc_contig_range(pfn, pfn + count, MIGRATE_CMA);
+
+		mutex_lock(&cma->lock);
+		bitmap_clear(cma->isolating, first, nr);
+		cma->isolate_seq++;
+		wake_up_all(&cma->wait);
+
 		if (ret == 0) {
-			bitmap_set(cma->bitmap, pageno, count);
 			page = pfn_to_page(pfn);
 			break;
-		} else if (ret != -EBUSY) {
-			break;
 		}
+		bitmap_clear(cma->bitmap, pageno, count);
+		if (ret != -EBUSY || ++retries > CMA_MAX_RETRIES)
+			break;
+
+		cma->stats.busy_retries++;
 		pr_debug("%s(): memory range at %p is busy, retrying\n",
 			 __func__, pfn_to_page(pfn));
 		/* try again with a bit different memory target */
 		start = pageno + mask + 1;
 	}
 
-	mutex_unlock(&cma_mutex);
+	cma_account(cma, page != NULL, begin);
+	mutex_unlock(&cma->lock);
 	pr_debug("%s(): returned %p\n", __func__, page);
 	return page;
 }
@@ -388,10 +510,67 @@ bool dma_release_from_contiguous(struct device *dev, struct page *pages,
 
 	VM_BUG_ON(pfn + count > cma->base_pfn + cma->count);
 
-	mutex_lock(&cma_mutex);
-	bitmap_clear(cma->bitmap, pfn - cma->base_pfn, count);
 	free_contig_range(pfn, count);
-	mutex_unlock(&cma_mutex);
+
+	mutex_lock(&cma->lock);
+	bitmap_clear(cma->bitmap, pfn - cma->base_pfn, count);
+	mutex_unlock(&cma->lock);
 
 	return true;
 }
+
+#ifdef CONFIG_DEBUG_FS
+static int cma_debugfs_show(struct seq_file *s, void *unused)
+{
+	unsigned i;
+
+	seq_printf(s, "%-10s %8s %8s %8s %8s %8s %8s %8s %8s\n",
+		   "base_pfn", "pages", "used", "allocs", "failed", "busy",
+		   "waits", "avg_us", "max_us");
+
+	for (i = 0; i < cma_area_count; i++) {
+		struct cma *cma = cma_areas[i];
+		struct cma_stats st;
+		unsigned long used, n;
+		u64 avg = 0;
+
+		mutex_lock(&cma->lock);
+		used = bitmap_weight(cma->bitmap, cma->count);
+		st = cma->stats;
+		mutex_unlock(&cma->lock);
+
+		n = st.allocs + st.failures;
+		if (n)
+			avg = div64_u64(st.total_ns, (u64)n * NSEC_PER_USEC);
+
+		seq_printf(s, "0x%08lx %8lu %8lu %8lu %8lu %8lu %8lu %8llu %8llu\n",
+			   cma->base_pfn, cma->count, used, st.allocs,
+			   st.failures, st.busy_retries, st.isolate_waits,
+			   (unsigned long long)avg,
+			   (unsigned long long)div64_u64(st.max_ns,
+							 NSEC_PER_USEC));
+	}
+	return 0;
+}
+
+static int cma_debugfs_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, cma_debugfs_show, inode->i_private);
+}
+
+static const struct file_operations cma_debugfs_fops = {
+	.open           = cma_debugfs_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
+static __init int cma_debugfs_init(void)
+{
+	if (cma_area_count)
+		debugfs_create_file("cma", S_IRUGO, NULL, NULL,
+				    &cma_debugfs_fops);
+	return 0;
+}
+late_initcall(cma_debugfs_init);
+#endif
@@ -528,6 +528,8 @@ int __init_or_module platform_driver_probe(struct platform_driver *drv,
 
 	/* make sure driver won't have bind/unbind attributes */
 	drv->driver.suppress_bind_attrs = true;
+	/* the probe result is needed right after registration */
+	drv->driver.probe_async = false;
 
 	/* temporary section violation during probe() */
 	drv->probe = probe;
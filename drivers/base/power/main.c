@@ -29,6 +29,9 @@
 #include <linux/async.h>
 #include <linux/suspend.h>
 #include <linux/timer.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include "../base.h"
 #include "power.h"
@@ -63,6 +66,23 @@ struct dpm_watchdog {
 
 static int async_error;
 
+/*
+ * Explicitly declared resume dependencies, see device_pm_add_supplier().
+ * Each one is on its consumer's power.suppliers list and on
+ * dpm_supplier_links, both protected by dpm_supplier_mtx.  If both are
+ * needed, dpm_list_mtx is taken first.
+ */
+struct pm_supplier {
+	struct list_head	node;
+	struct list_head	link;
+	struct device		*dev;
+	struct device		*consumer;
+	unsigned int		count;
+};
+
+static LIST_HEAD(dpm_supplier_links);
+static DEFINE_MUTEX(dpm_supplier_mtx);
+
 /**
  * device_pm_init - Initialize the PM-related part of a device object.
  * @dev: Device object being initialized.
@@ -73,6 +93,7 @@ void device_pm_init(struct device *dev)
 	dev->power.is_suspended = false;
 	init_completion(&dev->power.completion);
 	complete_all(&dev->power.completion);
+	INIT_LIST_HEAD(&dev->power.suppliers);
 	dev->power.wakeup = NULL;
 	spin_lock_init(&dev->power.lock);
 	pm_runtime_init(dev);
@@ -126,10 +147,135 @@ void device_pm_remove(struct device *dev)
 	dev_pm_qos_constraints_destroy(dev);
 	list_del_init(&dev->power.entry);
 	mutex_unlock(&dpm_list_mtx);
+	device_pm_remove_supplier(dev, NULL);
 	device_wakeup_disable(dev);
 	pm_runtime_remove(dev);
 }
 
+/*
+ * dpm_depends_on - Check if @dev has to be resumed after @target.
+ * Called with dpm_supplier_mtx held.
+ */
+static bool dpm_depends_on(struct device *dev, struct device *target)
+{
+	struct pm_supplier *s;
+
+	if (dev == target)
+		return true;
+
+	if (dev->parent && dpm_depends_on(dev->parent, target))
+		return true;
+
+	list_for_each_entry(s, &dev->power.suppliers, node)
+		if (dpm_depends_on(s->dev, target))
+			return true;
+
+	return false;
+}
+
+/*
+ * dpm_reorder_to_tail - Move a device and everything depending on it to the
+ * end of dpm_list.  Called with dpm_list_mtx and dpm_supplier_mtx held.
+ */
+static int dpm_reorder_to_tail(struct device *dev, void *not_used)
+{
+	struct pm_supplier *s;
+
+	/* Not registered yet, device_pm_add() will put it at the end. */
+	if (list_empty(&dev->power.entry))
+		return 0;
+
+	device_pm_move_last(dev);
+	device_for_each_child(dev, NULL, dpm_reorder_to_tail);
+	list_for_each_entry(s, &dpm_supplier_links, link)
+		if (s->dev == dev)
+			dpm_reorder_to_tail(s->consumer, NULL);
+
+	return 0;
+}
+
+/**
+ * device_pm_add_supplier - Make a device resume after another device.
+ * @dev: Device that depends on @supplier.
+ * @supplier: Device that has to be resumed before @dev.
+ *
+ * For dependencies not expressed by the device hierarchy, like a regulator
+ * of a PMIC used by a device on another bus.  @dev and everything that
+ * depends on it are moved after @supplier in dpm_list, so that synchronous
+ * resume runs in the right order, and whenever @dev or @supplier is resumed
+ * asynchronously, @dev waits for @supplier as it does for its parent.
+ *
+ * @supplier has to be registered already, and must not itself depend on
+ * @dev.  Dependencies are reference counted, every call has to be balanced
+ * by device_pm_remove_supplier().
+ */
+int device_pm_add_supplier(struct device *dev, struct device *supplier)
+{
+	struct pm_supplier *s, *new;
+	int error = 0;
+
+	new = kmalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return -ENOMEM;
+
+	mutex_lock(&dpm_list_mtx);
+	mutex_lock(&dpm_supplier_mtx);
+
+	list_for_each_entry(s, &dev->power.suppliers, node)
+		if (s->dev == supplier) {
+			s->count++;
+			goto out;
+		}
+
+	if (list_empty(&supplier->power.entry)
+	    || dpm_depends_on(supplier, dev)) {
+		error = -EINVAL;
+		goto out;
+	}
+
+	new->dev = get_device(supplier);
+	new->consumer = dev;
+	new->count = 1;
+	list_add_tail(&new->node, &dev->power.suppliers);
+	list_add_tail(&new->link, &dpm_supplier_links);
+	dpm_reorder_to_tail(dev, NULL);
+	new = NULL;
+
+ out:
+	mutex_unlock(&dpm_supplier_mtx);
+	mutex_unlock(&dpm_list_mtx);
+	kfree(new);
+	return error;
+}
+EXPORT_SYMBOL_GPL(device_pm_add_supplier);
+
+/**
+ * device_pm_remove_supplier - Drop a dependency added by
+ *			       device_pm_add_supplier().
+ * @dev: Device that depends on @supplier.
+ * @supplier: Supplier to drop a reference to, or NULL to drop all of them.
+ */
+void device_pm_remove_supplier(struct device *dev, struct device *supplier)
+{
+	struct pm_supplier *s, *n;
+	LIST_HEAD(list);
+
+	mutex_lock(&dpm_supplier_mtx);
+	list_for_each_entry_safe(s, n, &dev->power.suppliers, node) {
+		if (supplier && (s->dev != supplier || --s->count))
+			continue;
+		list_del(&s->link);
+		list_move(&s->node, &list);
+	}
+	mutex_unlock(&dpm_supplier_mtx);
+
+	list_for_each_entry_safe(s, n, &list, node) {
+		put_device(s->dev);
+		kfree(s);
+	}
+}
+EXPORT_SYMBOL_GPL(device_pm_remove_supplier);
+
 /**
  * device_pm_move_before - Move device in the PM core's list of active devices.
  * @deva: Device to move in dpm_list.
@@ -221,6 +367,59 @@ static void dpm_wait_for_children(struct device *dev, bool async)
        device_for_each_child(dev, &async, dpm_wait_fn);
 }
 
+static bool is_async(struct device *dev)
+{
+	return (dev->power.async_suspend || pm_async_resume_all)
+		&& pm_async_enabled && !pm_trace_is_enabled();
+}
+
+/*
+ * dpm_wait_resume - Wait for a device the caller depends on to be resumed.
+ * @dev: Device to wait for.
+ * @async: If unset, wait only if @dev is resumed asynchronously.
+ */
+static void dpm_wait_resume(struct device *dev, bool async)
+{
+	if (dev)
+		dpm_wait(dev, async || is_async(dev));
+}
+
+/*
+ * dpm_wait_for_suppliers - Wait for the declared suppliers of a device.
+ * @dev: Device whose suppliers to wait for.
+ * @async: If true, the device is being resumed asynchronously.
+ *
+ * dpm_supplier_mtx can't be held while waiting, so the suppliers are looked
+ * up one at a time.
+ */
+static void dpm_wait_for_suppliers(struct device *dev, bool async)
+{
+	struct pm_supplier *s;
+	struct device *supplier;
+	int i, n;
+
+	if (list_empty(&dev->power.suppliers))
+		return;
+
+	for (n = 0; ; n++) {
+		supplier = NULL;
+		i = 0;
+		mutex_lock(&dpm_supplier_mtx);
+		list_for_each_entry(s, &dev->power.suppliers, node)
+			if (i++ == n) {
+				supplier = get_device(s->dev);
+				break;
+			}
+		mutex_unlock(&dpm_supplier_mtx);
+
+		if (!supplier)
+			break;
+
+		dpm_wait_resume(supplier, async);
+		put_device(supplier);
+	}
+}
+
 /**
  * pm_op - Return the PM operation appropriate for given PM event.
  * @ops: PM operations to choose from.
@@ -376,10 +575,100 @@ static void dpm_show_time(ktime_t starttime, pm_message_t state, char *info)
 		usecs / USEC_PER_MSEC, usecs % USEC_PER_MSEC);
 }
 
+#ifdef CONFIG_DEBUG_FS
+/*
+ * Ring of the most recent device PM callbacks and their duration, shown in
+ * debugfs as "pm_device_times".
+ */
+#define DPM_TIMES_SIZE	256
+
+struct dpm_time {
+	char		name[32];
+	const char	*verb;
+	const char	*info;
+	ktime_t		start;
+	ktime_t		duration;
+	int		error;
+};
+
+static struct dpm_time dpm_times[DPM_TIMES_SIZE];
+static unsigned int dpm_times_next;
+static DEFINE_SPINLOCK(dpm_times_lock);
+
+static void dpm_record_time(struct device *dev, pm_message_t state,
+			    const char *info, ktime_t start, int error)
+{
+	ktime_t duration = ktime_sub(ktime_get(), start);
+	struct dpm_time *t;
+	unsigned long flags;
+
+	spin_lock_irqsave(&dpm_times_lock, flags);
+	t = &dpm_times[dpm_times_next];
+	dpm_times_next = (dpm_times_next + 1) % DPM_TIMES_SIZE;
+	strlcpy(t->name, dev_name(dev), sizeof(t->name));
+	t->verb = pm_verb(state.event);
+	t->info = info;
+	t->start = start;
+	t->duration = duration;
+	t->error = error;
+	spin_unlock_irqrestore(&dpm_times_lock, flags);
+}
+
+static int dpm_times_show(struct seq_file *s, void *unused)
+{
+	unsigned long flags;
+	unsigned int i;
+
+	seq_printf(s, "%12s %10s %5s  %-32s %s\n",
+		   "start_us", "usecs", "error", "device", "callback");
+
+	spin_lock_irqsave(&dpm_times_lock, flags);
+	for (i = 0; i < DPM_TIMES_SIZE; i++) {
+		struct dpm_time *t =
+			&dpm_times[(dpm_times_next + i) % DPM_TIMES_SIZE];
+
+		if (!t->verb)
+			continue;
+
+		seq_printf(s, "%12lld %10lld %5d  %-32s %s%s\n",
+			   (long long)ktime_to_us(t->start),
+			   (long long)ktime_to_us(t->duration), t->error,
+			   t->name, t->info ?: "", t->verb);
+	}
+	spin_unlock_irqrestore(&dpm_times_lock, flags);
+	return 0;
+}
+
+static int dpm_times_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, dpm_times_show, inode->i_private);
+}
+
+static const struct file_operations dpm_times_fops = {
+	.open           = dpm_times_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
+static __init int dpm_times_debugfs_init(void)
+{
+	debugfs_create_file("pm_device_times", S_IRUGO, NULL, NULL,
+			    &dpm_times_fops);
+	return 0;
+}
+late_initcall(dpm_times_debugfs_init);
+#else
+static inline void dpm_record_time(struct device *dev, pm_message_t state,
+				   const char *info, ktime_t start, int error)
+{
+}
+#endif
+
 static int dpm_run_callback(pm_callback_t cb, struct device *dev,
 			    pm_message_t state, char *info)
 {
-	ktime_t calltime;
+	ktime_t calltime, start;
 	int error;
 
 	if (!cb)
@@ -388,7 +677,9 @@ static int dpm_run_callback(pm_callback_t cb, struct device *dev,
 	calltime = initcall_debug_start(dev);
 
 	pm_dev_dbg(dev, state, info);
+	start = ktime_get();
 	error = cb(dev);
+	dpm_record_time(dev, state, info, start, error);
 	suspend_report_result(cb, error);
 
 	initcall_debug_report(dev, calltime, error);
@@ -627,7 +918,8 @@ static int device_resume(struct device *dev, pm_message_t state, bool async)
 	TRACE_DEVICE(dev);
 	TRACE_RESUME(0);
 
-	dpm_wait(dev->parent, async);
+	dpm_wait_resume(dev->parent, async);
+	dpm_wait_for_suppliers(dev, async);
 	device_lock(dev);
 
 	/*
@@ -712,12 +1004,6 @@ static void async_resume(void *data, async_cookie_t cookie)
 	put_device(dev);
 }
 
-static bool is_async(struct device *dev)
-{
-	return dev->power.async_suspend && pm_async_enabled
-		&& !pm_trace_is_enabled();
-}
-
 /**
  * dpm_resume - Execute "resume" callbacks for non-sysdev devices.
  * @state: PM transition of the system being carried out.
@@ -1383,7 +1669,7 @@ EXPORT_SYMBOL_GPL(__suspend_report_result);
  */
 int device_pm_wait_for_dev(struct device *subordinate, struct device *dev)
 {
-	dpm_wait(dev, subordinate->power.async_suspend);
+	dpm_wait(dev, subordinate->power.async_suspend || is_async(subordinate));
 	return async_error;
 }
 EXPORT_SYMBOL_GPL(device_pm_wait_for_dev);
@@ -16,6 +16,7 @@ static inline void pm_runtime_remove(struct device *dev) {}
 
 /* kernel/power/main.c */
 extern int pm_async_enabled;
+extern int pm_async_resume_all;
 
 /* drivers/base/power/main.c */
 extern struct list_head dpm_list;	/* The active device list */
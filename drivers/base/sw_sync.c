@@ -198,7 +198,11 @@ long sw_sync_ioctl_create_fence(struct sw_sync_timeline *obj, unsigned long arg)
 		goto err;
 	}
 
-	sync_fence_install(fence, fd);
+	err = sync_fence_install(fence, fd);
+	if (err < 0) {
+		sync_fence_put(fence);
+		goto err;
+	}
 
 	return 0;
 
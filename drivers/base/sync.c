@@ -19,6 +19,7 @@
 #include <linux/file.h>
 #include <linux/fs.h>
 #include <linux/kernel.h>
+#include <linux/moduleparam.h>
 #include <linux/poll.h>
 #include <linux/sched.h>
 #include <linux/seq_file.h>
@@ -33,17 +34,51 @@ static int _sync_pt_has_signaled(struct sync_pt *pt);
 static void sync_fence_free(struct kref *kref);
 static void sync_dump(void);
 
+/*
+ * Timelines and fences are only put on the global lists shown in debugfs
+ * while debug_lists is set, so creating and freeing them takes no global
+ * lock in normal operation.  Objects created while it is clear are never
+ * listed.
+ */
+static bool sync_debug_lists;
+module_param_named(debug_lists, sync_debug_lists, bool, S_IRUGO | S_IWUSR);
+
 static LIST_HEAD(sync_timeline_list_head);
 static DEFINE_SPINLOCK(sync_timeline_list_lock);
 
 static LIST_HEAD(sync_fence_list_head);
 static DEFINE_SPINLOCK(sync_fence_list_lock);
 
+static void sync_debug_list_add(struct list_head *entry,
+				struct list_head *head, spinlock_t *lock)
+{
+	unsigned long flags;
+
+	if (!sync_debug_lists)
+		return;
+
+	spin_lock_irqsave(lock, flags);
+	list_add_tail(entry, head);
+	spin_unlock_irqrestore(lock, flags);
+}
+
+/* entry is only ever added by its creator, so the unlocked check is safe */
+static void sync_debug_list_del(struct list_head *entry, spinlock_t *lock)
+{
+	unsigned long flags;
+
+	if (list_empty(entry))
+		return;
+
+	spin_lock_irqsave(lock, flags);
+	list_del_init(entry);
+	spin_unlock_irqrestore(lock, flags);
+}
+
 struct sync_timeline *sync_timeline_create(const struct sync_timeline_ops *ops,
 					   int size, const char *name)
 {
 	struct sync_timeline *obj;
-	unsigned long flags;
 
 	if (size < sizeof(struct sync_timeline))
 		return NULL;
@@ -62,9 +97,9 @@ struct sync_timeline *sync_timeline_create(const struct sync_timeline_ops *ops,
 	INIT_LIST_HEAD(&obj->active_list_head);
 	spin_lock_init(&obj->active_list_lock);
 
-	spin_lock_irqsave(&sync_timeline_list_lock, flags);
-	list_add_tail(&obj->sync_timeline_list, &sync_timeline_list_head);
-	spin_unlock_irqrestore(&sync_timeline_list_lock, flags);
+	INIT_LIST_HEAD(&obj->sync_timeline_list);
+	sync_debug_list_add(&obj->sync_timeline_list,
+			    &sync_timeline_list_head, &sync_timeline_list_lock);
 
 	return obj;
 }
@@ -74,14 +109,12 @@ static void sync_timeline_free(struct kref *kref)
 {
 	struct sync_timeline *obj =
 		container_of(kref, struct sync_timeline, kref);
-	unsigned long flags;
 
 	if (obj->ops->release_obj)
 		obj->ops->release_obj(obj);
 
-	spin_lock_irqsave(&sync_timeline_list_lock, flags);
-	list_del(&obj->sync_timeline_list);
-	spin_unlock_irqrestore(&sync_timeline_list_lock, flags);
+	sync_debug_list_del(&obj->sync_timeline_list,
+			    &sync_timeline_list_lock);
 
 	kfree(obj);
 }
@@ -142,8 +175,13 @@ void sync_timeline_signal(struct sync_timeline *obj)
 
 		if (_sync_pt_has_signaled(pt)) {
 			list_del_init(pos);
+			/*
+			 * A fence whose last reference is gone is about to
+			 * remove this pt from the timeline; don't revive it.
+			 */
+			if (!atomic_inc_not_zero(&pt->fence->kref.refcount))
+				continue;
 			list_add(&pt->signaled_list, &signaled_pts);
-			kref_get(&pt->fence->kref);
 		}
 	}
 
@@ -214,7 +252,10 @@ static struct sync_pt *sync_pt_dup(struct sync_pt *pt)
 	return pt->parent->ops->dup(pt);
 }
 
-/* Adds a sync pt to the active queue.  Called when added to a fence */
+/*
+ * Adds a sync pt to the active queue, or signals its fence right away if
+ * the pt has already signaled.  Called once the pt's fence is complete.
+ */
 static void sync_pt_activate(struct sync_pt *pt)
 {
 	struct sync_timeline *obj = pt->parent;
@@ -224,13 +265,13 @@ static void sync_pt_activate(struct sync_pt *pt)
 	spin_lock_irqsave(&obj->active_list_lock, flags);
 
 	err = _sync_pt_has_signaled(pt);
-	if (err != 0)
-		goto out;
-
-	list_add_tail(&pt->active_list, &obj->active_list_head);
+	if (err == 0)
+		list_add_tail(&pt->active_list, &obj->active_list_head);
 
-out:
 	spin_unlock_irqrestore(&obj->active_list_lock, flags);
+
+	if (err != 0)
+		sync_fence_signal_pt(pt);
 }
 
 static int sync_fence_release(struct inode *inode, struct file *file);
@@ -245,20 +286,18 @@ static const struct file_operations sync_fence_fops = {
 	.unlocked_ioctl = sync_fence_ioctl,
 };
 
+/*
+ * Fences start out without a file; one is only created by
+ * sync_fence_install() when the fence is handed to userspace.
+ */
 static struct sync_fence *sync_fence_alloc(const char *name)
 {
 	struct sync_fence *fence;
-	unsigned long flags;
 
 	fence = kzalloc(sizeof(struct sync_fence), GFP_KERNEL);
 	if (fence == NULL)
 		return NULL;
 
-	fence->file = anon_inode_getfile("sync_fence", &sync_fence_fops,
-					 fence, 0);
-	if (fence->file == NULL)
-		goto err;
-
 	kref_init(&fence->kref);
 	strlcpy(fence->name, name, sizeof(fence->name));
 
@@ -268,15 +307,32 @@ static struct sync_fence *sync_fence_alloc(const char *name)
 
 	init_waitqueue_head(&fence->wq);
 
-	spin_lock_irqsave(&sync_fence_list_lock, flags);
-	list_add_tail(&fence->sync_fence_list, &sync_fence_list_head);
-	spin_unlock_irqrestore(&sync_fence_list_lock, flags);
+	INIT_LIST_HEAD(&fence->sync_fence_list);
 
 	return fence;
+}
 
-err:
-	kfree(fence);
-	return NULL;
+/*
+ * Arms a fully built fence.  @pending counts the pts that have yet to
+ * signal, so only the last of them (or the first error) has to take the
+ * waiter lock; the others signal without touching the fence's locks.
+ */
+static void sync_fence_activate(struct sync_fence *fence)
+{
+	struct list_head *pos;
+	int n = 0;
+
+	sync_debug_list_add(&fence->sync_fence_list, &sync_fence_list_head,
+			    &sync_fence_list_lock);
+
+	list_for_each(pos, &fence->pt_list_head)
+		n++;
+	atomic_set(&fence->pending, n);
+
+	list_for_each(pos, &fence->pt_list_head) {
+		struct sync_pt *pt = container_of(pos, struct sync_pt, pt_list);
+		sync_pt_activate(pt);
+	}
 }
 
 /* TODO: implement a create which takes more that one sync_pt */
@@ -293,7 +349,7 @@ struct sync_fence *sync_fence_create(const char *name, struct sync_pt *pt)
 
 	pt->fence = fence;
 	list_add(&pt->pt_list, &fence->pt_list_head);
-	sync_pt_activate(pt);
+	sync_fence_activate(fence);
 
 	return fence;
 }
@@ -313,7 +369,6 @@ static int sync_fence_copy_pts(struct sync_fence *dst, struct sync_fence *src)
 
 		new_pt->fence = dst;
 		list_add(&new_pt->pt_list, &dst->pt_list_head);
-		sync_pt_activate(new_pt);
 	}
 
 	return 0;
@@ -345,7 +400,6 @@ static int sync_fence_merge_pts(struct sync_fence *dst, struct sync_fence *src)
 					new_pt->fence = dst;
 					list_replace(&dst_pt->pt_list,
 						     &new_pt->pt_list);
-					sync_pt_activate(new_pt);
 					sync_pt_free(dst_pt);
 				}
 				collapsed = true;
@@ -361,23 +415,12 @@ static int sync_fence_merge_pts(struct sync_fence *dst, struct sync_fence *src)
 
 			new_pt->fence = dst;
 			list_add(&new_pt->pt_list, &dst->pt_list_head);
-			sync_pt_activate(new_pt);
 		}
 	}
 
 	return 0;
 }
 
-static void sync_fence_detach_pts(struct sync_fence *fence)
-{
-	struct list_head *pos, *n;
-
-	list_for_each_safe(pos, n, &fence->pt_list_head) {
-		struct sync_pt *pt = container_of(pos, struct sync_pt, pt_list);
-		sync_timeline_remove_pt(pt);
-	}
-}
-
 static void sync_fence_free_pts(struct sync_fence *fence)
 {
 	struct list_head *pos, *n;
@@ -391,6 +434,7 @@ static void sync_fence_free_pts(struct sync_fence *fence)
 struct sync_fence *sync_fence_fdget(int fd)
 {
 	struct file *file = fget(fd);
+	struct sync_fence *fence;
 
 	if (file == NULL)
 		return NULL;
@@ -398,7 +442,11 @@ struct sync_fence *sync_fence_fdget(int fd)
 	if (file->f_op != &sync_fence_fops)
 		goto err;
 
-	return file->private_data;
+	fence = file->private_data;
+	kref_get(&fence->kref);
+	fput(file);
+
+	return fence;
 
 err:
 	fput(file);
@@ -408,35 +456,31 @@ EXPORT_SYMBOL(sync_fence_fdget);
 
 void sync_fence_put(struct sync_fence *fence)
 {
-	fput(fence->file);
+	kref_put(&fence->kref, sync_fence_free);
 }
 EXPORT_SYMBOL(sync_fence_put);
 
-void sync_fence_install(struct sync_fence *fence, int fd)
-{
-	fd_install(fd, fence->file);
-}
-EXPORT_SYMBOL(sync_fence_install);
-
-static int sync_fence_get_status(struct sync_fence *fence)
+int sync_fence_install(struct sync_fence *fence, int fd)
 {
-	struct list_head *pos;
-	int status = 1;
+	struct file *file = fence->file;
 
-	list_for_each(pos, &fence->pt_list_head) {
-		struct sync_pt *pt = container_of(pos, struct sync_pt, pt_list);
-		int pt_status = pt->status;
-
-		if (pt_status < 0) {
-			status = pt_status;
-			break;
-		} else if (status == 1) {
-			status = pt_status;
-		}
+	if (file == NULL) {
+		/* the new file takes over the caller's reference */
+		file = anon_inode_getfile("sync_fence", &sync_fence_fops,
+					  fence, 0);
+		if (IS_ERR(file))
+			return PTR_ERR(file);
+		fence->file = file;
+	} else {
+		/* already exported: share the existing file */
+		get_file(file);
+		sync_fence_put(fence);
 	}
 
-	return status;
+	fd_install(fd, file);
+	return 0;
 }
+EXPORT_SYMBOL(sync_fence_install);
 
 struct sync_fence *sync_fence_merge(const char *name,
 				    struct sync_fence *a, struct sync_fence *b)
@@ -456,7 +500,7 @@ struct sync_fence *sync_fence_merge(const char *name,
 	if (err < 0)
 		goto err;
 
-	fence->status = sync_fence_get_status(fence);
+	sync_fence_activate(fence);
 
 	return fence;
 err:
@@ -473,9 +517,11 @@ static void sync_fence_signal_pt(struct sync_pt *pt)
 	struct list_head *pos;
 	struct list_head *n;
 	unsigned long flags;
-	int status;
+	int status = pt->status;
 
-	status = sync_fence_get_status(fence);
+	/* the fence signals with its last pt, or errors with its first */
+	if (status > 0 && !atomic_dec_and_test(&fence->pending))
+		return;
 
 	spin_lock_irqsave(&fence->waiter_list_lock, flags);
 	/*
@@ -589,6 +635,13 @@ static void sync_fence_free(struct kref *kref)
 {
 	struct sync_fence *fence = container_of(kref, struct sync_fence, kref);
 
+	sync_debug_list_del(&fence->sync_fence_list, &sync_fence_list_lock);
+
+	/*
+	 * Freeing the pts removes them from their timelines.  Until then
+	 * sync_timeline_signal() may still find them, but it won't take a
+	 * reference on a fence whose count has dropped to zero.
+	 */
 	sync_fence_free_pts(fence);
 
 	kfree(fence);
@@ -597,25 +650,8 @@ static void sync_fence_free(struct kref *kref)
 static int sync_fence_release(struct inode *inode, struct file *file)
 {
 	struct sync_fence *fence = file->private_data;
-	unsigned long flags;
 
-	/*
-	 * We need to remove all ways to access this fence before droping
-	 * our ref.
-	 *
-	 * start with its membership in the global fence list
-	 */
-	spin_lock_irqsave(&sync_fence_list_lock, flags);
-	list_del(&fence->sync_fence_list);
-	spin_unlock_irqrestore(&sync_fence_list_lock, flags);
-
-	/*
-	 * remove its pts from their parents so that sync_timeline_signal()
-	 * can't reference the fence.
-	 */
-	sync_fence_detach_pts(fence);
-
-	kref_put(&fence->kref, sync_fence_free);
+	sync_fence_put(fence);
 
 	return 0;
 }
@@ -678,7 +714,9 @@ static long sync_fence_ioctl_merge(struct sync_fence *fence, unsigned long arg)
 		goto err_put_fence3;
 	}
 
-	sync_fence_install(fence3, fd);
+	err = sync_fence_install(fence3, fd);
+	if (err < 0)
+		goto err_put_fence3;
 	sync_fence_put(fence2);
 	return 0;
 
@@ -875,6 +913,9 @@ static int sync_debugfs_show(struct seq_file *s, void *unused)
 	unsigned long flags;
 	struct list_head *pos;
 
+	if (!sync_debug_lists)
+		seq_printf(s, "objects are only listed while sync.debug_lists is set\n\n");
+
 	seq_printf(s, "objs:\n--------------\n");
 
 	spin_lock_irqsave(&sync_timeline_list_lock, flags);
@@ -325,6 +325,14 @@ typedef struct dhd_info {
 	bool rpcth_timer_active;
 	bool fdaggr;
 #endif
+#ifdef DHD_RX_NAPI
+	/* Received frames are batched here by dhd_rx_frame() and handed
+	 * to GRO from dhd_napi_poll() in NET_RX softirq context.
+	 */
+	struct napi_struct rx_napi;
+	struct sk_buff_head rx_napi_queue;
+	struct net_device *rx_napi_netdev;	/* non-NULL while rx_napi is enabled */
+#endif /* DHD_RX_NAPI */
 } dhd_info_t;
 
 /* Flag to indicate if we should download firmware on driver load */
@@ -1603,6 +1611,97 @@ static const char *_get_packet_type_str(uint16 type)
 }
 #endif /* DHD_RX_DUMP */
 
+#ifdef DHD_RX_NAPI
+#define DHD_NAPI_WEIGHT		64	/* frames per dhd_napi_poll() */
+
+static int
+dhd_napi_poll(struct napi_struct *napi, int budget)
+{
+	dhd_info_t *dhd = container_of(napi, dhd_info_t, rx_napi);
+	struct sk_buff_head rx_process_queue;
+	struct sk_buff *skb;
+	unsigned long flags;
+	int processed = 0;
+
+	__skb_queue_head_init(&rx_process_queue);
+
+	/* Take up to a budget's worth of frames under one lock hold */
+	spin_lock_irqsave(&dhd->rx_napi_queue.lock, flags);
+	while (processed < budget &&
+	       (skb = __skb_dequeue(&dhd->rx_napi_queue)) != NULL) {
+		__skb_queue_tail(&rx_process_queue, skb);
+		processed++;
+	}
+	spin_unlock_irqrestore(&dhd->rx_napi_queue.lock, flags);
+
+	while ((skb = __skb_dequeue(&rx_process_queue)) != NULL)
+		napi_gro_receive(napi, skb);
+
+	if (processed < budget) {
+		napi_complete(napi);
+		/* Catch frames queued between the drain and napi_complete() */
+		if (!skb_queue_empty(&dhd->rx_napi_queue))
+			napi_reschedule(napi);
+	}
+
+	return processed;
+}
+
+/* Like netif_rx(), don't let the backlog grow past netdev_max_backlog
+ * when the stack can't keep up; the excess is dropped and counted.
+ */
+static void
+dhd_napi_schedule(dhd_info_t *dhd, struct sk_buff_head *batch)
+{
+	struct sk_buff *skb;
+	unsigned long flags;
+	int room;
+
+	spin_lock_irqsave(&dhd->rx_napi_queue.lock, flags);
+	room = netdev_max_backlog - (int)skb_queue_len(&dhd->rx_napi_queue);
+	if (room >= (int)skb_queue_len(batch)) {
+		skb_queue_splice_tail_init(batch, &dhd->rx_napi_queue);
+	} else {
+		while (room-- > 0 && (skb = __skb_dequeue(batch)) != NULL)
+			__skb_queue_tail(&dhd->rx_napi_queue, skb);
+		dhd->pub.rx_dropped += skb_queue_len(batch);
+	}
+	spin_unlock_irqrestore(&dhd->rx_napi_queue.lock, flags);
+
+	while ((skb = __skb_dequeue(batch)) != NULL)
+		dev_kfree_skb_any(skb);
+
+	/* Normally called from the DPC thread: with BHs held off,
+	 * local_bh_enable() runs the poll right here instead of
+	 * waking ksoftirqd.
+	 */
+	local_bh_disable();
+	napi_schedule(&dhd->rx_napi);
+	local_bh_enable();
+}
+
+static void
+dhd_napi_enable(dhd_info_t *dhd, struct net_device *net)
+{
+	netif_napi_add(net, &dhd->rx_napi, dhd_napi_poll, DHD_NAPI_WEIGHT);
+	napi_enable(&dhd->rx_napi);
+	dhd->rx_napi_netdev = net;
+	DHD_INFO(("%s: NAPI rx enabled on %s\n", __FUNCTION__, net->name));
+}
+
+static void
+dhd_napi_disable(dhd_info_t *dhd)
+{
+	if (!dhd->rx_napi_netdev)
+		return;
+
+	dhd->rx_napi_netdev = NULL;
+	napi_disable(&dhd->rx_napi);
+	netif_napi_del(&dhd->rx_napi);
+	skb_queue_purge(&dhd->rx_napi_queue);
+}
+#endif /* DHD_RX_NAPI */
+
 void
 dhd_rx_frame(dhd_pub_t *dhdp, int ifidx, void *pktbuf, int numpkt, uint8 chan)
 {
@@ -1616,6 +1715,9 @@ dhd_rx_frame(dhd_pub_t *dhdp, int ifidx, void *pktbuf, int numpkt, uint8 chan)
 	wl_event_msg_t event;
 	int tout_rx = 0;
 	int tout_ctrl = 0;
+#ifdef DHD_RX_NAPI
+	struct sk_buff_head napi_batch;
+#endif /* DHD_RX_NAPI */
 
 #ifdef DHD_RX_DUMP
 #ifdef DHD_RX_FULL_DUMP
@@ -1627,6 +1729,10 @@ dhd_rx_frame(dhd_pub_t *dhdp, int ifidx, void *pktbuf, int numpkt, uint8 chan)
 
 	DHD_TRACE(("%s: Enter\n", __FUNCTION__));
 
+#ifdef DHD_RX_NAPI
+	__skb_queue_head_init(&napi_batch);
+#endif /* DHD_RX_NAPI */
+
 	for (i = 0; pktbuf && i < numpkt; i++, pktbuf = pnext) {
 #ifdef WLBTAMP
 		struct ether_header *eh;
@@ -1805,6 +1911,13 @@ dhd_rx_frame(dhd_pub_t *dhdp, int ifidx, void *pktbuf, int numpkt, uint8 chan)
 		dhdp->dstats.rx_bytes += skb->len;
 		dhdp->rx_packets++; /* Local count */
 
+#ifdef DHD_RX_NAPI
+		if (dhd->rx_napi_netdev) {
+			__skb_queue_tail(&napi_batch, skb);
+			continue;
+		}
+#endif /* DHD_RX_NAPI */
+
 		if (in_interrupt()) {
 			netif_rx(skb);
 		} else {
@@ -1826,6 +1939,11 @@ dhd_rx_frame(dhd_pub_t *dhdp, int ifidx, void *pktbuf, int numpkt, uint8 chan)
 		}
 	}
 
+#ifdef DHD_RX_NAPI
+	if (!skb_queue_empty(&napi_batch))
+		dhd_napi_schedule(dhd, &napi_batch);
+#endif /* DHD_RX_NAPI */
+
 	DHD_OS_WAKE_LOCK_RX_TIMEOUT_ENABLE(dhdp, tout_rx);
 	DHD_OS_WAKE_LOCK_CTRL_TIMEOUT_ENABLE(dhdp, tout_ctrl);
 }
@@ -3037,6 +3155,9 @@ dhd_attach(osl_t *osh, struct dhd_bus *bus, uint bus_hdrlen, void *dev)
 	spin_lock_init(&dhd->sdlock);
 	spin_lock_init(&dhd->txqlock);
 	spin_lock_init(&dhd->dhd_lock);
+#ifdef DHD_RX_NAPI
+	skb_queue_head_init(&dhd->rx_napi_queue);
+#endif /* DHD_RX_NAPI */
 
 	/* Initialize Wakelock stuff */
 	spin_lock_init(&dhd->wakelock_spinlock);
@@ -4117,6 +4238,10 @@ dhd_net_attach(dhd_pub_t *dhdp, int ifidx)
 		DHD_ERROR(("couldn't register the net device, err %d\n", err));
 		goto fail;
 	}
+#ifdef DHD_RX_NAPI
+	if (ifidx == 0 && !dhd->rx_napi_netdev)
+		dhd_napi_enable(dhd, net);
+#endif /* DHD_RX_NAPI */
 	printf("Broadcom Dongle Host Driver: register interface [%s]"
 		" MAC: "MACDBG"\n",
 		net->name,
@@ -4223,6 +4348,11 @@ void dhd_detach(dhd_pub_t *dhdp)
 		PROC_STOP(&dhd->thr_sysioc_ctl);
 	}
 
+#ifdef DHD_RX_NAPI
+	/* Bus is down, nothing feeds rx_napi_queue any more */
+	dhd_napi_disable(dhd);
+#endif /* DHD_RX_NAPI */
+
 	/* delete all interfaces, start with virtual  */
 	if (dhd->dhd_state & DHD_ATTACH_STATE_ADD_IF) {
 		int i = 1;
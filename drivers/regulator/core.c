@@ -1431,6 +1431,15 @@ found:
 out:
 	mutex_unlock(&regulator_list_mutex);
 
+	/*
+	 * Resume the consumer after the regulator, so that e.g. a device on
+	 * another bus than its PMIC can't resume before the PMIC does.  The
+	 * PMIC itself getting one of its own regulators is refused, which is
+	 * fine.
+	 */
+	if (!IS_ERR(regulator) && dev)
+		device_pm_add_supplier(dev, &regulator->rdev->dev);
+
 	return regulator;
 }
 
@@ -1529,8 +1538,11 @@ void regulator_put(struct regulator *regulator)
 	if (regulator == NULL || IS_ERR(regulator))
 		return;
 
-	mutex_lock(&regulator_list_mutex);
 	rdev = regulator->rdev;
+	if (regulator->dev)
+		device_pm_remove_supplier(regulator->dev, &rdev->dev);
+
+	mutex_lock(&regulator_list_mutex);
 
 	debugfs_remove_recursive(regulator->debugfs);
 
@@ -17,6 +17,8 @@
  * 51 Franklin St - Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#include <linux/list.h>
+#include <linux/mutex.h>
 #include <linux/slab.h>
 #include <linux/uaccess.h>
 #include <linux/export.h>
@@ -26,25 +28,62 @@
 #include "nvmap.h"
 #include "nvmap_ioctl.h"
 
+/*
+ * The sg table and the pin (IOVMM mapping) of a buffer are built on the
+ * first map by a device and kept until the last attachment of that device
+ * goes away, so buffers exchanged every frame between camera, GPU and
+ * display are only mapped once per device.
+ */
+struct nvmap_dmabuf_map {
+	struct list_head node;
+	struct device *dev;
+	int attached;
+	struct sg_table *sgt;
+};
+
 struct nvmap_handle_info {
 	struct nvmap_client *client;
 	u32 id;
 	struct nvmap_handle_ref *ref;
 	struct nvmap_handle *handle;
+	struct mutex maps_lock;
+	struct list_head maps;
 };
 
+static struct sg_table *nvmap_dmabuf_build_sgt(struct nvmap_handle_info *info);
+static void nvmap_dmabuf_free_sgt(struct nvmap_handle_info *info,
+				  struct sg_table *sgt);
+
 static int nvmap_dmabuf_attach(struct dma_buf *dmabuf, struct device *dev,
 			       struct dma_buf_attachment *attach)
 {
 	struct nvmap_handle_info *info = dmabuf->priv;
 	struct nvmap_handle_ref *ref;
+	struct nvmap_dmabuf_map *map;
 
 	ref = nvmap_duplicate_handle_id(info->client, info->id);
 	if (IS_ERR(ref))
 		return PTR_ERR(ref);
 
+	mutex_lock(&info->maps_lock);
+	list_for_each_entry(map, &info->maps, node)
+		if (map->dev == dev)
+			goto found;
+
+	map = kzalloc(sizeof(*map), GFP_KERNEL);
+	if (!map) {
+		mutex_unlock(&info->maps_lock);
+		nvmap_free(info->client, ref);
+		return -ENOMEM;
+	}
+	map->dev = dev;
+	list_add(&map->node, &info->maps);
+found:
+	map->attached++;
+	mutex_unlock(&info->maps_lock);
+
 	info->ref = ref;
-	attach->priv = info;
+	attach->priv = map;
 
 	dev_dbg(dev, "%s(%08x)\n", __func__, info->id);
 	return 0;
@@ -54,6 +93,16 @@ static void nvmap_dmabuf_detach(struct dma_buf *dmabuf,
 				struct dma_buf_attachment *attach)
 {
 	struct nvmap_handle_info *info = dmabuf->priv;
+	struct nvmap_dmabuf_map *map = attach->priv;
+
+	mutex_lock(&info->maps_lock);
+	if (--map->attached == 0) {
+		if (map->sgt)
+			nvmap_dmabuf_free_sgt(info, map->sgt);
+		list_del(&map->node);
+		kfree(map);
+	}
+	mutex_unlock(&info->maps_lock);
 
 	nvmap_free(info->client, info->ref);
 
@@ -64,6 +113,40 @@ static struct sg_table *nvmap_dmabuf_map_dma_buf(
 	struct dma_buf_attachment *attach, enum dma_data_direction dir)
 {
 	struct nvmap_handle_info *info = attach->dmabuf->priv;
+	struct nvmap_dmabuf_map *map = attach->priv;
+	struct sg_table *sgt;
+
+	mutex_lock(&info->maps_lock);
+	if (!map->sgt) {
+		sgt = nvmap_dmabuf_build_sgt(info);
+		if (IS_ERR(sgt)) {
+			mutex_unlock(&info->maps_lock);
+			return sgt;
+		}
+		map->sgt = sgt;
+	}
+	sgt = map->sgt;
+	mutex_unlock(&info->maps_lock);
+
+	dev_dbg(attach->dev, "%s(%08x)\n", __func__, info->id);
+	return sgt;
+}
+
+/* The cached table stays mapped until the device's last detach. */
+static void nvmap_dmabuf_unmap_dma_buf(struct dma_buf_attachment *attach,
+				       struct sg_table *sgt,
+				       enum dma_data_direction dir)
+{
+	struct nvmap_handle_info *info = attach->dmabuf->priv;
+	struct nvmap_dmabuf_map *map = attach->priv;
+
+	WARN_ON(sgt != map->sgt);
+
+	dev_dbg(attach->dev, "%s(%08x)\n", __func__, info->id);
+}
+
+static struct sg_table *nvmap_dmabuf_build_sgt(struct nvmap_handle_info *info)
+{
 	struct nvmap_handle *handle = info->ref->handle;
 	int err, npages = PAGE_ALIGN(handle->size) >> PAGE_SHIFT;
 	struct sg_table *sgt;
@@ -97,7 +180,6 @@ static struct sg_table *nvmap_dmabuf_map_dma_buf(
 	sg_dma_len(sgt->sgl) = handle->size;
 	sg_dma_address(sgt->sgl) = addr;
 
-	dev_dbg(attach->dev, "%s(%08x)\n", __func__, info->id);
 	return sgt;
 
 err_sgalloc:
@@ -107,25 +189,30 @@ err_pin:
 	return ERR_PTR(err);
 }
 
-static void nvmap_dmabuf_unmap_dma_buf(struct dma_buf_attachment *attach,
-				       struct sg_table *sgt,
-				       enum dma_data_direction dir)
+static void nvmap_dmabuf_free_sgt(struct nvmap_handle_info *info,
+				  struct sg_table *sgt)
 {
-	struct nvmap_handle_info *info = attach->dmabuf->priv;
-
 	nvmap_unpin(info->client, info->ref);
 	sg_free_table(sgt);
 	kfree(sgt);
-
-	dev_dbg(attach->dev, "%s(%08x)\n", __func__, info->id);
 }
 
 static void nvmap_dmabuf_release(struct dma_buf *dmabuf)
 {
 	struct nvmap_handle_info *info = dmabuf->priv;
+	struct nvmap_dmabuf_map *map, *tmp;
 
 	pr_debug("%s(%08x)\n", __func__, info->id);
 
+	/* All importers must have detached; drop anything left behind. */
+	list_for_each_entry_safe(map, tmp, &info->maps, node) {
+		WARN_ON(1);
+		if (map->sgt)
+			nvmap_dmabuf_free_sgt(info, map->sgt);
+		list_del(&map->node);
+		kfree(map);
+	}
+
 	nvmap_handle_put(info->handle);
 	nvmap_client_put(info->client);
 	kfree(info);
@@ -215,6 +302,8 @@ struct dma_buf *nvmap_share_dmabuf(struct nvmap_client *client, u32 id)
 	info->id = id;
 	info->handle = handle;
 	info->client = client;
+	mutex_init(&info->maps_lock);
+	INIT_LIST_HEAD(&info->maps);
 
 	dmabuf = dma_buf_export(info, &nvmap_dma_buf_ops, handle->size,
 				O_RDWR);
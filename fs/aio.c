@@ -164,7 +164,8 @@ static int aio_setup_ring(struct kioctx *ctx)
 	ring->id = ctx->user_id;
 	ring->head = ring->tail = 0;
 	ring->magic = AIO_RING_MAGIC;
-	ring->compat_features = AIO_RING_COMPAT_FEATURES;
+	ring->compat_features = AIO_RING_COMPAT_FEATURES |
+				AIO_RING_COMPAT_CMPXCHG_HEAD;
 	ring->incompat_features = AIO_RING_INCOMPAT_FEATURES;
 	ring->header_length = sizeof(struct aio_ring);
 	kunmap_atomic(ring);
@@ -265,7 +266,6 @@ static struct kioctx *ioctx_alloc(unsigned nr_events)
 
 	atomic_set(&ctx->users, 2);
 	spin_lock_init(&ctx->ctx_lock);
-	spin_lock_init(&ctx->ring_info.ring_lock);
 	init_waitqueue_head(&ctx->wait);
 
 	INIT_LIST_HEAD(&ctx->active_reqs);
@@ -1061,14 +1061,16 @@ EXPORT_SYMBOL(aio_complete);
 /* aio_read_evt
  *	Pull an event off of the ioctx's event ring.  Returns the number of 
  *	events fetched (0 or 1 ;-)
- *	FIXME: make this use cmpxchg.
- *	TODO: make the ringbuffer user mmap()able (requires FIXME).
+ *	The head is advanced with cmpxchg, so any number of io_getevents()
+ *	callers and userspace reapers working directly on the mmap()ed
+ *	ring (see AIO_RING_COMPAT_CMPXCHG_HEAD) can consume events
+ *	concurrently without a lock.
  */
 static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
 {
 	struct aio_ring_info *info = &ioctx->ring_info;
 	struct aio_ring *ring;
-	unsigned long head;
+	unsigned old, head;
 	int ret = 0;
 
 	ring = kmap_atomic(info->ring_pages[0]);
@@ -1076,24 +1078,28 @@ static int aio_read_evt(struct kioctx *ioctx, struct io_event *ent)
 		 (unsigned long)ring->head, (unsigned long)ring->tail,
 		 (unsigned long)ring->nr);
 
-	if (ring->head == ring->tail)
-		goto out;
+	for (;;) {
+		struct io_event *evp;
 
-	spin_lock(&info->ring_lock);
+		old = ACCESS_ONCE(ring->head);
+		head = old % info->nr;
+		if (head == ACCESS_ONCE(ring->tail))
+			break;
+		smp_rmb(); /* read the tail before the event it covers */
 
-	head = ring->head % info->nr;
-	if (head != ring->tail) {
-		struct io_event *evp = aio_ring_event(info, head);
+		evp = aio_ring_event(info, head);
 		*ent = *evp;
+		put_aio_ring_event(evp);
+
 		head = (head + 1) % info->nr;
 		smp_mb(); /* finish reading the event before updatng the head */
-		ring->head = head;
-		ret = 1;
-		put_aio_ring_event(evp);
+		if (cmpxchg(&ring->head, old, head) == old) {
+			ret = 1;
+			break;
+		}
+		/* somebody else took this event, try the next one */
 	}
-	spin_unlock(&info->ring_lock);
 
-out:
 	dprintk("leaving aio_read_evt: %d  h%lu t%lu\n", ret,
 		 (unsigned long)ring->head, (unsigned long)ring->tail);
 	kunmap_atomic(ring);
@@ -1217,11 +1217,17 @@ struct ext4_sb_info {
 	unsigned int s_mb_min_to_scan;
 	unsigned int s_mb_stats;
 	unsigned int s_mb_order2_reqs;
+	unsigned int s_mb_optimize_scan;
 	unsigned int s_mb_group_prealloc;
 	unsigned int s_max_writeback_mb_bump;
 	/* where last allocation was done - for stream allocation */
 	unsigned long s_mb_last_group;
 	unsigned long s_mb_last_start;
+	/* initialized groups, indexed by the order of their largest free
+	 * extent, so cr 0 allocations can go straight to a suitable group */
+	struct list_head *s_mb_largest_free_orders;
+	rwlock_t *s_mb_largest_free_orders_locks;
+	atomic_t s_mb_uninit_groups;	/* groups not in the index yet */
 
 	/* stats for buddy allocator */
 	atomic_t s_bal_reqs;	/* number of reqs with len > 1 */
@@ -1230,6 +1236,8 @@ struct ext4_sb_info {
 	atomic_t s_bal_ex_scanned;	/* total extents scanned */
 	atomic_t s_bal_goals;	/* goal hits */
 	atomic_t s_bal_breaks;	/* too long searches */
+	atomic_t s_bal_groups_scanned;	/* groups scanned for reqs */
+	atomic_t s_bal_index_hits;	/* reqs served via the order index */
 	atomic_t s_bal_2orders;	/* 2^order hits */
 	spinlock_t s_bal_lock;
 	unsigned long s_mb_buddies_generated;
@@ -1246,6 +1254,12 @@ struct ext4_sb_info {
 	unsigned long s_sectors_written_start;
 	u64 s_kbytes_written;
 
+	/* fsync statistics */
+	atomic_t s_fsync_count;		/* fsync/fdatasync calls */
+	atomic_t s_fsync_commits;	/* calls that had to start a commit */
+	atomic_t s_fsync_flushes;	/* calls that issued their own flush */
+	atomic64_t s_fsync_usecs;	/* total time spent in ext4_sync_file */
+
 	unsigned int s_log_groups_per_flex;
 	struct flex_groups *s_flex_groups;
 
@@ -2155,7 +2169,10 @@ struct ext4_group_info {
 	ext4_grpblk_t	bb_free;	/* total free blocks */
 	ext4_grpblk_t	bb_fragments;	/* nr of freespace fragments */
 	ext4_grpblk_t	bb_largest_free_order;/* order of largest frag in BG */
+	ext4_group_t	bb_group;	/* group number */
 	struct          list_head bb_prealloc_list;
+	struct		list_head bb_largest_free_order_node; /* in
+					 * s_mb_largest_free_orders[] */
 #ifdef DOUBLE_CHECK
 	void            *bb_bitmap;
 #endif
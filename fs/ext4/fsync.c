@@ -210,17 +210,20 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 	struct inode *inode = file->f_mapping->host;
 	struct ext4_inode_info *ei = EXT4_I(inode);
 	journal_t *journal = EXT4_SB(inode->i_sb)->s_journal;
+	struct ext4_sb_info *sbi = EXT4_SB(inode->i_sb);
 	int ret;
 	tid_t commit_tid;
 	bool needs_barrier = false;
+	ktime_t start_time = ktime_get();
 
 	J_ASSERT(ext4_journal_current_handle() == NULL);
 
 	trace_ext4_sync_file_enter(file, datasync);
+	atomic_inc(&sbi->s_fsync_count);
 
 	ret = filemap_write_and_wait_range(inode->i_mapping, start, end);
 	if (ret)
-		return ret;
+		goto out_stats;
 	mutex_lock(&inode->i_mutex);
 
 	if (inode->i_sb->s_flags & MS_RDONLY)
@@ -252,6 +255,8 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 	 *  safe in-journal, which is all fsync() needs to ensure.
 	 */
 	if (ext4_should_journal_data(inode)) {
+		/* Always starts (and waits for) a commit of its own */
+		atomic_inc(&sbi->s_fsync_commits);
 		ret = ext4_force_commit(inode->i_sb);
 		goto out;
 	}
@@ -260,12 +265,18 @@ int ext4_sync_file(struct file *file, loff_t start, loff_t end, int datasync)
 	if (journal->j_flags & JBD2_BARRIER &&
 	    !jbd2_trans_will_send_data_barrier(journal, commit_tid))
 		needs_barrier = true;
-	jbd2_log_start_commit(journal, commit_tid);
+	if (jbd2_log_start_commit(journal, commit_tid))
+		atomic_inc(&sbi->s_fsync_commits);
 	ret = jbd2_log_wait_commit(journal, commit_tid);
-	if (needs_barrier)
+	if (needs_barrier) {
+		atomic_inc(&sbi->s_fsync_flushes);
 		blkdev_issue_flush(inode->i_sb->s_bdev, GFP_KERNEL, NULL);
+	}
  out:
 	mutex_unlock(&inode->i_mutex);
+ out_stats:
+	atomic64_add(ktime_to_us(ktime_sub(ktime_get(), start_time)),
+		     &sbi->s_fsync_usecs);
 	trace_ext4_sync_file_exit(inode, ret);
 	return ret;
 }
@@ -75,6 +75,12 @@ extern u8 mb_enable_debug;
  */
 #define MB_DEFAULT_STATS		0
 
+/*
+ * with 'ext4_mb_optimize_scan' cr 0 requests which miss the goal group look
+ * up a group in the largest free order lists instead of walking all groups
+ */
+#define MB_DEFAULT_OPTIMIZE_SCAN	0
+
 /*
  * files smaller than MB_DEFAULT_STREAM_THRESHOLD are served
  * by the stream allocator, which purpose is to pack requests
@@ -94,6 +100,11 @@ extern u8 mb_enable_debug;
  */
 #define MB_DEFAULT_GROUP_PREALLOC	512
 
+/*
+ * number of buddy orders, order 0 being the bitmap itself
+ */
+#define MB_NUM_ORDERS(sb)		((sb)->s_blocksize_bits + 2)
+
 
 struct ext4_free_data {
 	/* MUST be the first member */
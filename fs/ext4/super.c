@@ -2381,6 +2381,17 @@ static ssize_t lifetime_write_kbytes_show(struct ext4_attr *a,
 			  EXT4_SB(sb)->s_sectors_written_start) >> 1)));
 }
 
+static ssize_t fsync_avg_usecs_show(struct ext4_attr *a,
+				    struct ext4_sb_info *sbi, char *buf)
+{
+	u64 usecs = atomic64_read(&sbi->s_fsync_usecs);
+	unsigned int count = atomic_read(&sbi->s_fsync_count);
+
+	if (count)
+		do_div(usecs, count);
+	return snprintf(buf, PAGE_SIZE, "%llu\n", (unsigned long long)usecs);
+}
+
 static ssize_t inode_readahead_blks_store(struct ext4_attr *a,
 					  struct ext4_sb_info *sbi,
 					  const char *buf, size_t count)
@@ -2405,6 +2416,14 @@ static ssize_t sbi_ui_show(struct ext4_attr *a,
 	return snprintf(buf, PAGE_SIZE, "%u\n", *ui);
 }
 
+static ssize_t sbi_atomic_show(struct ext4_attr *a,
+			       struct ext4_sb_info *sbi, char *buf)
+{
+	atomic_t *counter = (atomic_t *) (((char *) sbi) + a->offset);
+
+	return snprintf(buf, PAGE_SIZE, "%d\n", atomic_read(counter));
+}
+
 static ssize_t sbi_ui_store(struct ext4_attr *a,
 			    struct ext4_sb_info *sbi,
 			    const char *buf, size_t count)
@@ -2433,6 +2452,8 @@ static struct ext4_attr ext4_attr_##name = __ATTR(name, mode, show, store)
 #define EXT4_RW_ATTR(name) EXT4_ATTR(name, 0644, name##_show, name##_store)
 #define EXT4_RW_ATTR_SBI_UI(name, elname)	\
 	EXT4_ATTR_OFFSET(name, 0644, sbi_ui_show, sbi_ui_store, elname)
+#define EXT4_RO_ATTR_SBI_ATOMIC(name, elname)	\
+	EXT4_ATTR_OFFSET(name, 0444, sbi_atomic_show, NULL, elname)
 #define ATTR_LIST(name) &ext4_attr_##name.attr
 
 EXT4_RO_ATTR(delayed_allocation_blocks);
@@ -2445,9 +2466,14 @@ EXT4_RW_ATTR_SBI_UI(mb_stats, s_mb_stats);
 EXT4_RW_ATTR_SBI_UI(mb_max_to_scan, s_mb_max_to_scan);
 EXT4_RW_ATTR_SBI_UI(mb_min_to_scan, s_mb_min_to_scan);
 EXT4_RW_ATTR_SBI_UI(mb_order2_req, s_mb_order2_reqs);
+EXT4_RW_ATTR_SBI_UI(mb_optimize_scan, s_mb_optimize_scan);
 EXT4_RW_ATTR_SBI_UI(mb_stream_req, s_mb_stream_request);
 EXT4_RW_ATTR_SBI_UI(mb_group_prealloc, s_mb_group_prealloc);
 EXT4_RW_ATTR_SBI_UI(max_writeback_mb_bump, s_max_writeback_mb_bump);
+EXT4_RO_ATTR_SBI_ATOMIC(fsync_count, s_fsync_count);
+EXT4_RO_ATTR_SBI_ATOMIC(fsync_commits, s_fsync_commits);
+EXT4_RO_ATTR_SBI_ATOMIC(fsync_flushes, s_fsync_flushes);
+EXT4_RO_ATTR(fsync_avg_usecs);
 
 static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(delayed_allocation_blocks),
@@ -2459,9 +2485,14 @@ static struct attribute *ext4_attrs[] = {
 	ATTR_LIST(mb_max_to_scan),
 	ATTR_LIST(mb_min_to_scan),
 	ATTR_LIST(mb_order2_req),
+	ATTR_LIST(mb_optimize_scan),
 	ATTR_LIST(mb_stream_req),
 	ATTR_LIST(mb_group_prealloc),
 	ATTR_LIST(max_writeback_mb_bump),
+	ATTR_LIST(fsync_count),
+	ATTR_LIST(fsync_commits),
+	ATTR_LIST(fsync_flushes),
+	ATTR_LIST(fsync_avg_usecs),
 	NULL,
 };
 
@@ -698,6 +698,30 @@ static void wb_update_bandwidth(struct bdi_writeback *wb,
 	__bdi_update_bandwidth(wb->bdi, 0, 0, 0, 0, 0, start_time);
 }
 
+/*
+ * Background writeback may back off while reads on the device are over
+ * their latency target, but never once dirty pages reach the hard limit,
+ * since dirtiers are then waiting on us.
+ */
+static bool wb_read_latency_backoff(struct backing_dev_info *bdi)
+{
+	unsigned long background_thresh, dirty_thresh;
+	unsigned long nr_dirty;
+
+	if (!bdi_read_latency_exceeded(bdi))
+		return false;
+
+	global_dirty_limits(&background_thresh, &dirty_thresh);
+	nr_dirty = global_page_state(NR_FILE_DIRTY) +
+		   global_page_state(NR_UNSTABLE_NFS) +
+		   global_page_state(NR_WRITEBACK);
+	if (nr_dirty >= dirty_thresh)
+		return false;
+
+	atomic_long_inc(&bdi->read_lat_backoffs);
+	return true;
+}
+
 /*
  * Explicit flushing or periodic writeback of "old" data.
  *
@@ -750,6 +774,19 @@ static long wb_writeback(struct bdi_writeback *wb,
 		if (work->for_background && !over_bground_thresh(wb->bdi))
 			break;
 
+		/*
+		 * Let foreground reads through before queueing more
+		 * background writes on a device that is already slow
+		 * to serve them.
+		 */
+		if ((work->for_background || work->for_kupdate) &&
+		    wb_read_latency_backoff(wb->bdi)) {
+			spin_unlock(&wb->list_lock);
+			schedule_timeout_interruptible(msecs_to_jiffies(20));
+			spin_lock(&wb->list_lock);
+			continue;
+		}
+
 		/*
 		 * Kupdate and background works are special and we want to
 		 * include all inodes that need writing. Livelock avoidance is
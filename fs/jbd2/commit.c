@@ -27,6 +27,7 @@
 #include <linux/bio.h>
 #include <linux/blkdev.h>
 #include <linux/bitops.h>
+#include <linux/math64.h>
 #include <trace/events/jbd2.h>
 
 /*
@@ -718,10 +719,18 @@ start_journal_io:
 	/* 
 	 * If the journal is not located on the file system device,
 	 * then we must flush the file system device before we issue
-	 * the commit record
+	 * the commit record.
+	 *
+	 * The same goes for async commit on an internal journal: the
+	 * commit record goes out without a preflush and the checksum only
+	 * covers the journal blocks, so ordered data must already be
+	 * stable or a crash could replay metadata pointing at stale data.
+	 * The journal blocks themselves are still not waited on here.
 	 */
 	if (commit_transaction->t_need_data_flush &&
-	    (journal->j_fs_dev != journal->j_dev) &&
+	    (journal->j_fs_dev != journal->j_dev ||
+	     JBD2_HAS_INCOMPAT_FEATURE(journal,
+				       JBD2_FEATURE_INCOMPAT_ASYNC_COMMIT)) &&
 	    (journal->j_flags & JBD2_BARRIER))
 		blkdev_issue_flush(journal->j_fs_dev, GFP_NOFS, NULL);
 
@@ -1028,6 +1037,7 @@ restart_loop:
 		atomic_read(&commit_transaction->t_handle_count);
 	trace_jbd2_run_stats(journal->j_fs_dev->bd_dev,
 			     commit_transaction->t_tid, &stats.run);
+	commit_time = ktime_to_ns(ktime_sub(ktime_get(), start_time));
 
 	/*
 	 * Calculate overall stats
@@ -1042,13 +1052,20 @@ restart_loop:
 	journal->j_stats.run.rs_handle_count += stats.run.rs_handle_count;
 	journal->j_stats.run.rs_blocks += stats.run.rs_blocks;
 	journal->j_stats.run.rs_blocks_logged += stats.run.rs_blocks_logged;
+	jbd2_hist_add(&journal->j_stats_hist, JBD2_HIST_LOCKED,
+		      jiffies_to_msecs(stats.run.rs_locked));
+	jbd2_hist_add(&journal->j_stats_hist, JBD2_HIST_FLUSHING,
+		      jiffies_to_msecs(stats.run.rs_flushing));
+	jbd2_hist_add(&journal->j_stats_hist, JBD2_HIST_LOGGING,
+		      jiffies_to_msecs(stats.run.rs_logging));
+	jbd2_hist_add(&journal->j_stats_hist, JBD2_HIST_COMMIT,
+		      (unsigned long)div_u64(commit_time, NSEC_PER_USEC));
 	spin_unlock(&journal->j_history_lock);
 
 	commit_transaction->t_state = T_COMMIT_CALLBACK;
 	J_ASSERT(commit_transaction == journal->j_committing_transaction);
 	journal->j_commit_sequence = commit_transaction->t_tid;
 	journal->j_committing_transaction = NULL;
-	commit_time = ktime_to_ns(ktime_sub(ktime_get(), start_time));
 
 	/*
 	 * weight the commit time higher than the average time so we don't
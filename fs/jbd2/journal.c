@@ -838,6 +838,7 @@ void jbd2_update_log_tail(journal_t *journal, tid_t tid, unsigned long block)
 struct jbd2_stats_proc_session {
 	journal_t *journal;
 	struct transaction_stats_s *stats;
+	struct jbd2_stats_hist hist;
 	int start;
 	int max;
 };
@@ -852,6 +853,26 @@ static void *jbd2_seq_info_next(struct seq_file *seq, void *v, loff_t *pos)
 	return NULL;
 }
 
+static void jbd2_seq_hist_show(struct seq_file *seq,
+			       struct jbd2_stats_hist *hist)
+{
+	static const char * const names[JBD2_HIST_NR] = {
+		[JBD2_HIST_LOCKED]	= "locked (ms)",
+		[JBD2_HIST_FLUSHING]	= "flushing (ms)",
+		[JBD2_HIST_LOGGING]	= "logging (ms)",
+		[JBD2_HIST_COMMIT]	= "commit (us)",
+	};
+	int i, j;
+
+	seq_printf(seq, "histograms (0, then 1<<n-1 to 1<<n per column):\n");
+	for (i = 0; i < JBD2_HIST_NR; i++) {
+		seq_printf(seq, "  %-14s", names[i]);
+		for (j = 0; j < JBD2_HIST_BUCKETS; j++)
+			seq_printf(seq, " %u", hist->h[i][j]);
+		seq_printf(seq, "\n");
+	}
+}
+
 static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 {
 	struct jbd2_stats_proc_session *s = seq->private;
@@ -881,6 +902,7 @@ static int jbd2_seq_info_show(struct seq_file *seq, void *v)
 	    s->stats->run.rs_blocks / s->stats->ts_tid);
 	seq_printf(seq, "  %lu logged blocks per transaction\n",
 	    s->stats->run.rs_blocks_logged / s->stats->ts_tid);
+	jbd2_seq_hist_show(seq, &s->hist);
 	return 0;
 }
 
@@ -912,6 +934,7 @@ static int jbd2_seq_info_open(struct inode *inode, struct file *file)
 	}
 	spin_lock(&journal->j_history_lock);
 	memcpy(s->stats, &journal->j_stats, size);
+	s->hist = journal->j_stats_hist;
 	s->journal = journal;
 	spin_unlock(&journal->j_history_lock);
 
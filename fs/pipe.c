@@ -1212,6 +1212,20 @@ static inline unsigned int round_pipe_size(unsigned int size)
 	return roundup_pow_of_two(nr_pages) << PAGE_SHIFT;
 }
 
+/*
+ * Grow an empty pipe private to the caller (the splice_direct_to_actor()
+ * internal pipe) so that it can hold @size bytes, up to pipe_max_size.
+ * The pipe is left alone if the allocation fails.
+ */
+void pipe_grow_private(struct pipe_inode_info *pipe, unsigned int size)
+{
+	unsigned int nr_pages;
+
+	nr_pages = round_pipe_size(min(size, pipe_max_size)) >> PAGE_SHIFT;
+	if (nr_pages > pipe->buffers && !pipe->nrbufs)
+		pipe_set_size(pipe, nr_pages);
+}
+
 /*
  * This should work even if CONFIG_PROC_FS isn't set, as proc_dointvec_minmax
  * will return an error.
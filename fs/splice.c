@@ -1192,6 +1192,14 @@ ssize_t splice_direct_to_actor(struct file *in, struct splice_desc *sd,
 		current->splice_pipe = pipe;
 	}
 
+	/*
+	 * Size the internal pipe for the transfer instead of moving large
+	 * sendfile()s PIPE_DEF_BUFFERS pages at a time.  The pipe stays
+	 * with the task, so later transfers reuse the larger ring.
+	 */
+	if (sd->total_len > pipe->buffers * PAGE_SIZE)
+		pipe_grow_private(pipe, min_t(size_t, sd->total_len, UINT_MAX));
+
 	/*
 	 * Do the splice.
 	 */
@@ -39,6 +39,14 @@
 #define YAFFS_GC_GOOD_ENOUGH 2
 #define YAFFS_GC_PASSIVE_THRESHOLD 4
 
+/*
+ * GC scores are fixed point with YAFFS_GC_SCORE_SHIFT fractional bits so that
+ * nearly full blocks don't all truncate to 0. The age cap keeps the score
+ * within 32 bits for up to 512 chunks per block.
+ */
+#define YAFFS_GC_SCORE_SHIFT 8
+#define YAFFS_GC_MAX_AGE 0x3fff
+
 #include "yaffs_ecc.h"
 
 /* Forward declarations */
@@ -1395,9 +1403,37 @@ static int yaffs_change_obj_name(struct yaffs_obj *obj,
  *   provides write buffering.
  *
  *   There are a limited number (~10) of cache chunks per device so that we don't
- *   need a very intelligent search.
+ *   need a very intelligent search. Lookups by (object, chunk) are done on
+ *   every short read and write though, so the chunks in use are also kept on
+ *   a small hash to avoid walking the whole array for each access.
  */
 
+static inline struct list_head *yaffs_cache_bucket(struct yaffs_dev *dev,
+						   const struct yaffs_obj *obj,
+						   int chunk_id)
+{
+	return &dev->cache_hash[(obj->obj_id + chunk_id) &
+				(YAFFS_CACHE_HASH_BUCKETS - 1)];
+}
+
+/* Attach a cache chunk to an object's chunk and (re)hash it.
+ * The chunk may still be hashed under a clean entry it is replacing.
+ */
+static void yaffs_cache_bind(struct yaffs_dev *dev, struct yaffs_cache *cache,
+			     struct yaffs_obj *obj, int chunk_id)
+{
+	cache->object = obj;
+	cache->chunk_id = chunk_id;
+	list_move(&cache->hash_link, yaffs_cache_bucket(dev, obj, chunk_id));
+}
+
+/* Detach a cache chunk from its object so that it can be reused. */
+static void yaffs_cache_unbind(struct yaffs_cache *cache)
+{
+	list_del_init(&cache->hash_link);
+	cache->object = NULL;
+}
+
 static int yaffs_obj_cache_dirty(struct yaffs_obj *obj)
 {
 	struct yaffs_dev *dev = obj->my_dev;
@@ -1449,7 +1485,7 @@ static void yaffs_flush_file_cache(struct yaffs_obj *obj)
 						      cache->data,
 						      cache->n_bytes, 1);
 				cache->dirty = 0;
-				cache->object = NULL;
+				yaffs_cache_unbind(cache);
 			}
 
 		} while (cache && chunk_written > 0);
@@ -1567,14 +1603,17 @@ static struct yaffs_cache *yaffs_find_chunk_cache(const struct yaffs_obj *obj,
 						  int chunk_id)
 {
 	struct yaffs_dev *dev = obj->my_dev;
-	int i;
+	struct list_head *bucket;
+	struct yaffs_cache *cache;
+
 	if (dev->param.n_caches > 0) {
-		for (i = 0; i < dev->param.n_caches; i++) {
-			if (dev->cache[i].object == obj &&
-			    dev->cache[i].chunk_id == chunk_id) {
+		bucket = yaffs_cache_bucket(dev, obj, chunk_id);
+		list_for_each_entry(cache, bucket, hash_link) {
+			if (cache->object == obj &&
+			    cache->chunk_id == chunk_id) {
 				dev->cache_hits++;
 
-				return &dev->cache[i];
+				return cache;
 			}
 		}
 	}
@@ -1616,7 +1655,7 @@ static void yaffs_invalidate_chunk_cache(struct yaffs_obj *object, int chunk_id)
 		    yaffs_find_chunk_cache(object, chunk_id);
 
 		if (cache)
-			cache->object = NULL;
+			yaffs_cache_unbind(cache);
 	}
 }
 
@@ -1632,7 +1671,7 @@ static void yaffs_invalidate_whole_cache(struct yaffs_obj *in)
 		/* Invalidate it. */
 		for (i = 0; i < dev->param.n_caches; i++) {
 			if (dev->cache[i].object == in)
-				dev->cache[i].object = NULL;
+				yaffs_cache_unbind(&dev->cache[i]);
 		}
 	}
 }
@@ -2388,6 +2427,7 @@ void yaffs_block_became_dirty(struct yaffs_dev *dev, int block_no)
 	if (block_no == dev->gc_dirtiest) {
 		dev->gc_dirtiest = 0;
 		dev->gc_pages_in_use = 0;
+		dev->gc_dirtiest_score = 0;
 	}
 
 	if (!bi->needs_retiring) {
@@ -2716,8 +2756,32 @@ static int yaffs_gc_block(struct yaffs_dev *dev, int block, int whole_block)
 }
 
 /*
- * FindBlockForgarbageCollection is used to select the dirtiest block (or close enough)
- * for garbage collection.
+ * Cost-benefit score for collecting a block: free space gained times age,
+ * over the cost of copying out the live chunks, ie. (1 - u) * age / u.
+ * Old blocks are mostly cold data that won't get any dirtier, so they are
+ * worth collecting at a higher utilisation than recently written ones.
+ * Age comes from the sequence numbers so yaffs1 degrades to plain greedy,
+ * as does aggressive gc where getting an erased block soon is what counts.
+ */
+static u32 yaffs_gc_score(struct yaffs_dev *dev, struct yaffs_block_info *bi,
+			  int pages_used, int aggressive)
+{
+	u32 age = 1;
+
+	if (!aggressive && dev->param.is_yaffs2 &&
+	    dev->seq_number > bi->seq_number) {
+		age = dev->seq_number - bi->seq_number;
+		if (age > YAFFS_GC_MAX_AGE)
+			age = YAFFS_GC_MAX_AGE;
+	}
+
+	return ((dev->param.chunks_per_block - pages_used) <<
+		YAFFS_GC_SCORE_SHIFT) / (pages_used + 1) * age;
+}
+
+/*
+ * FindBlockForgarbageCollection is used to select the best block to
+ * collect, by cost-benefit score, for garbage collection.
  */
 
 static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
@@ -2734,6 +2798,7 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 	/* First let's see if we need to grab a prioritised block */
 	if (dev->has_pending_prioritised_gc && !aggressive) {
 		dev->gc_dirtiest = 0;
+		dev->gc_dirtiest_score = 0;
 		bi = dev->block_info;
 		for (i = dev->internal_start_block;
 		     i <= dev->internal_end_block && !selected; i++) {
@@ -2802,6 +2867,8 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 		     i < iterations &&
 		     (dev->gc_dirtiest < 1 ||
 		      dev->gc_pages_in_use > YAFFS_GC_GOOD_ENOUGH); i++) {
+			u32 score;
+
 			dev->gc_block_finder++;
 			if (dev->gc_block_finder < dev->internal_start_block ||
 			    dev->gc_block_finder > dev->internal_end_block)
@@ -2812,18 +2879,34 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 
 			pages_used = bi->pages_in_use - bi->soft_del_pages;
 
-			if (bi->block_state == YAFFS_BLOCK_STATE_FULL &&
-			    pages_used < dev->param.chunks_per_block &&
-			    (dev->gc_dirtiest < 1
-			     || pages_used < dev->gc_pages_in_use)
+			/* Only blocks this pass would accept compete on score */
+			if (bi->block_state != YAFFS_BLOCK_STATE_FULL ||
+			    pages_used >= dev->param.chunks_per_block ||
+			    pages_used > threshold)
+				continue;
+
+			score = yaffs_gc_score(dev, bi, pages_used, aggressive);
+
+			if ((dev->gc_dirtiest < 1
+			     || score > dev->gc_dirtiest_score)
 			    && yaffs_block_ok_for_gc(dev, bi)) {
 				dev->gc_dirtiest = dev->gc_block_finder;
 				dev->gc_pages_in_use = pages_used;
+				dev->gc_dirtiest_score = score;
 			}
 		}
 
-		if (dev->gc_dirtiest > 0 && dev->gc_pages_in_use <= threshold)
+		if (dev->gc_dirtiest > 0 && dev->gc_pages_in_use <= threshold) {
 			selected = dev->gc_dirtiest;
+		} else {
+			/*
+			 * A candidate kept from an earlier, more lenient pass
+			 * must not block finding a better one next time.
+			 */
+			dev->gc_dirtiest = 0;
+			dev->gc_pages_in_use = 0;
+			dev->gc_dirtiest_score = 0;
+		}
 	}
 
 	/*
@@ -2859,6 +2942,7 @@ static unsigned yaffs_find_gc_block(struct yaffs_dev *dev,
 
 		dev->gc_dirtiest = 0;
 		dev->gc_pages_in_use = 0;
+		dev->gc_dirtiest_score = 0;
 		dev->gc_not_done = 0;
 		if (dev->refresh_skip > 0)
 			dev->refresh_skip--;
@@ -3581,8 +3665,7 @@ int yaffs_file_rd(struct yaffs_obj *in, u8 * buffer, loff_t offset, int n_bytes)
 				if (!cache) {
 					cache =
 					    yaffs_grab_chunk_cache(in->my_dev);
-					cache->object = in;
-					cache->chunk_id = chunk;
+					yaffs_cache_bind(dev, cache, in, chunk);
 					cache->dirty = 0;
 					cache->locked = 0;
 					yaffs_rd_data_obj(in, chunk,
@@ -3707,8 +3790,7 @@ int yaffs_do_file_wr(struct yaffs_obj *in, const u8 * buffer, loff_t offset,
 				if (!cache
 				    && yaffs_check_alloc_available(dev, 1)) {
 					cache = yaffs_grab_chunk_cache(dev);
-					cache->object = in;
-					cache->chunk_id = chunk;
+					yaffs_cache_bind(dev, cache, in, chunk);
 					cache->dirty = 0;
 					cache->locked = 0;
 					yaffs_rd_data_obj(in, chunk,
@@ -4957,8 +5039,12 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 		if (dev->cache)
 			memset(dev->cache, 0, cache_bytes);
 
+		for (i = 0; i < YAFFS_CACHE_HASH_BUCKETS; i++)
+			INIT_LIST_HEAD(&dev->cache_hash[i]);
+
 		for (i = 0; i < dev->param.n_caches && buf; i++) {
 			dev->cache[i].object = NULL;
+			INIT_LIST_HEAD(&dev->cache[i].hash_link);
 			dev->cache[i].last_use = 0;
 			dev->cache[i].dirty = 0;
 			dev->cache[i].data = buf =
@@ -4971,6 +5057,8 @@ int yaffs_guts_initialise(struct yaffs_dev *dev)
 	}
 
 	dev->cache_hits = 0;
+	dev->bg_gc_deferrals = 0;
+	dev->bg_checkpoints = 0;
 
 	if (!init_failed) {
 		dev->gc_cleanup_list =
@@ -84,6 +84,7 @@
 #define YAFFS_SEQUENCE_CHECKPOINT_DATA  0x21
 
 #define YAFFS_MAX_SHORT_OP_CACHES	20
+#define YAFFS_CACHE_HASH_BUCKETS	16	/* Must be a power of 2 */
 
 #define YAFFS_N_TEMP_BUFFERS		6
 
@@ -109,6 +110,7 @@
 /* ChunkCache is used for short read/write operations.*/
 struct yaffs_cache {
 	struct yaffs_obj *object;
+	struct list_head hash_link;	/* Entry in dev->cache_hash[] */
 	int chunk_id;
 	int last_use;
 	int dirty;
@@ -547,6 +549,9 @@ struct yaffs_param {
 	int (*query_block_fn) (struct yaffs_dev * dev, int block_no,
 			       enum yaffs_block_state * state,
 			       u32 * seq_number);
+	/* Optional: read the tags of all chunks in a block in one go */
+	int (*read_block_tags_fn) (struct yaffs_dev * dev, int block_no,
+				   struct yaffs_ext_tags * tags);
 #endif
 
 	/* The remove_obj_fn function must be supplied by OS flavours that
@@ -667,6 +672,7 @@ struct yaffs_dev {
 	unsigned gc_block_finder;
 	unsigned gc_dirtiest;
 	unsigned gc_pages_in_use;
+	u32 gc_dirtiest_score;	/* Cost-benefit score of gc_dirtiest */
 	unsigned gc_not_done;
 	unsigned gc_block;
 	unsigned gc_chunk;
@@ -686,6 +692,7 @@ struct yaffs_dev {
 
 	struct yaffs_cache *cache;
 	int cache_last_use;
+	struct list_head cache_hash[YAFFS_CACHE_HASH_BUCKETS];
 
 	/* Stuff for background deletion and unlinked files. */
 	struct yaffs_obj *unlinked_dir;	/* Directory where unlinked and deleted files live. */
@@ -734,6 +741,8 @@ struct yaffs_dev {
 	u32 n_unmarked_deletions;
 	u32 refresh_count;
 	u32 cache_hits;
+	u32 bg_gc_deferrals;
+	u32 bg_checkpoints;
 
 };
 
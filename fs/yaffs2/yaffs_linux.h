@@ -25,9 +25,11 @@ struct yaffs_linux_context {
 	struct task_struct *bg_thread;	/* Background thread for this device */
 	int bg_running;
 	struct mutex gross_lock;	/* Gross locking mutex*/
+	atomic_t gross_waiters;	/* Foreground tasks waiting on gross_lock */
 	u8 *spare_buffer;	/* For mtdif2 use. Don't know the size of the buffer
 				 * at compile time so we have to allocate it.
 				 */
+	u8 *block_spare_buffer;	/* Spare of a whole block, for scanning */
 	struct list_head search_contexts;
 	void (*put_super_fn) (struct super_block * sb);
 
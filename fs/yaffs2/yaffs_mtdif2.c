@@ -165,6 +165,58 @@ int nandmtd2_read_chunk_tags(struct yaffs_dev *dev, int nand_chunk,
 		return YAFFS_FAIL;
 }
 
+/* Read the tags of every chunk in a block with a single oob-only read.
+ * Used by the mount scan, which otherwise issues one read per chunk.
+ * Not usable with inband tags since those live in the data area.
+ */
+int nandmtd2_read_block_tags(struct yaffs_dev *dev, int block_no,
+			     struct yaffs_ext_tags *tags)
+{
+	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+	struct mtd_oob_ops ops;
+	int retval;
+	int i;
+
+	loff_t addr = ((loff_t) block_no) * dev->param.chunks_per_block *
+	    dev->param.total_bytes_per_chunk;
+
+	struct yaffs_packed_tags2 pt;
+
+	int packed_tags_size =
+	    dev->param.no_tags_ecc ? sizeof(pt.t) : sizeof(pt);
+	void *packed_tags_ptr =
+	    dev->param.no_tags_ecc ? (void *)&pt.t : (void *)&pt;
+
+	yaffs_trace(YAFFS_TRACE_MTD,
+		"nandmtd2_read_block_tags block %d", block_no);
+
+	if (dev->param.inband_tags || !lc->block_spare_buffer ||
+	    packed_tags_size > mtd->oobavail)
+		return YAFFS_FAIL;
+
+	/* In auto mode each page contributes oobavail bytes to the buffer */
+	ops.mode = MTD_OOB_AUTO;
+	ops.ooblen = mtd->oobavail * dev->param.chunks_per_block;
+	ops.len = 0;
+	ops.ooboffs = 0;
+	ops.datbuf = NULL;
+	ops.oobbuf = lc->block_spare_buffer;
+	retval = mtd->read_oob(mtd, addr, &ops);
+
+	if (retval != 0 || ops.oobretlen != ops.ooblen)
+		return YAFFS_FAIL;
+
+	for (i = 0; i < dev->param.chunks_per_block; i++) {
+		memcpy(packed_tags_ptr,
+		       lc->block_spare_buffer + i * mtd->oobavail,
+		       packed_tags_size);
+		yaffs_unpack_tags2(&tags[i], &pt, !dev->param.no_tags_ecc);
+	}
+
+	return YAFFS_OK;
+}
+
 int nandmtd2_mark_block_bad(struct yaffs_dev *dev, int block_no)
 {
 	struct mtd_info *mtd = yaffs_dev_to_mtd(dev);
@@ -50,6 +50,38 @@ int yaffs_rd_chunk_tags_nand(struct yaffs_dev *dev, int nand_chunk,
 	return result;
 }
 
+/* Read the tags of all the chunks in a block, if the driver can batch that.
+ * Returns YAFFS_FAIL if it can't, in which case the caller should fall back
+ * to reading chunk by chunk.
+ */
+int yaffs_rd_block_tags_nand(struct yaffs_dev *dev, int block_no,
+			     struct yaffs_ext_tags *tags)
+{
+	int result;
+	int i;
+
+	if (!dev->param.read_block_tags_fn)
+		return YAFFS_FAIL;
+
+	result = dev->param.read_block_tags_fn(dev,
+					       block_no - dev->block_offset,
+					       tags);
+	if (result != YAFFS_OK)
+		return result;
+
+	dev->n_page_reads += dev->param.chunks_per_block;
+
+	for (i = 0; i < dev->param.chunks_per_block; i++) {
+		if (tags[i].ecc_result > YAFFS_ECC_RESULT_NO_ERROR) {
+			yaffs_handle_chunk_error(dev,
+						 yaffs_get_block_info(dev,
+								      block_no));
+		}
+	}
+
+	return result;
+}
+
 int yaffs_wr_chunk_tags_nand(struct yaffs_dev *dev,
 			     int nand_chunk,
 			     const u8 * buffer, struct yaffs_ext_tags *tags)
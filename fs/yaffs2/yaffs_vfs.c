@@ -97,6 +97,11 @@ unsigned int yaffs_wr_attempts = YAFFS_WR_ATTEMPTS;
 unsigned int yaffs_auto_checkpoint = 1;
 unsigned int yaffs_gc_control = 1;
 unsigned int yaffs_bg_enable = 1;
+#ifdef CONFIG_YAFFS_BG_CHECKPOINT_IDLE
+unsigned int yaffs_bg_checkpoint_idle = CONFIG_YAFFS_BG_CHECKPOINT_IDLE;
+#else
+unsigned int yaffs_bg_checkpoint_idle;
+#endif
 
 /* Module Parameters */
 module_param(yaffs_trace_mask, uint, 0644);
@@ -104,6 +109,7 @@ module_param(yaffs_wr_attempts, uint, 0644);
 module_param(yaffs_auto_checkpoint, uint, 0644);
 module_param(yaffs_gc_control, uint, 0644);
 module_param(yaffs_bg_enable, uint, 0644);
+module_param(yaffs_bg_checkpoint_idle, uint, 0644);
 
 
 #define yaffs_inode_to_obj_lv(iptr) ((iptr)->i_private)
@@ -123,11 +129,29 @@ static unsigned yaffs_gc_control_callback(struct yaffs_dev *dev)
 
 static void yaffs_gross_lock(struct yaffs_dev *dev)
 {
+	struct yaffs_linux_context *lc = yaffs_dev_to_lc(dev);
+
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locking %p", current);
-	mutex_lock(&(yaffs_dev_to_lc(dev)->gross_lock));
+	atomic_inc(&lc->gross_waiters);
+	mutex_lock(&lc->gross_lock);
+	atomic_dec(&lc->gross_waiters);
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs locked %p", current);
 }
 
+/* Lock for the background thread. Does not count as a foreground waiter. */
+static void yaffs_gross_lock_bg(struct yaffs_dev *dev)
+{
+	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs bg locking %p", current);
+	mutex_lock(&(yaffs_dev_to_lc(dev)->gross_lock));
+	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs bg locked %p", current);
+}
+
+/* Is a foreground operation queued up behind the gross lock? */
+static int yaffs_gross_contended(struct yaffs_dev *dev)
+{
+	return atomic_read(&(yaffs_dev_to_lc(dev)->gross_waiters)) > 0;
+}
+
 static void yaffs_gross_unlock(struct yaffs_dev *dev)
 {
 	yaffs_trace(YAFFS_TRACE_LOCK, "yaffs unlocking %p", current);
@@ -1598,6 +1622,26 @@ static int yaffs_do_sync_fs(struct super_block *sb, int request_checkpoint)
 	return 0;
 }
 
+/*
+ * Idle-time checkpoint from the background thread. This doesn't go through
+ * yaffs_do_sync_fs(): walking sb->s_inodes isn't safe from here, and the bg
+ * thread must not count as a foreground waiter on the gross lock. Inode
+ * attributes still dirty in the VFS are written by the next regular sync;
+ * the checkpoint covers the object state yaffs itself holds.
+ */
+static void yaffs_bg_checkpoint(struct yaffs_dev *dev)
+{
+	yaffs_gross_lock_bg(dev);
+	if (!dev->is_checkpointed && !yaffs_gross_contended(dev) &&
+	    !yaffs_bg_gc_urgency(dev)) {
+		yaffs_update_dirty_dirs(dev);
+		yaffs_flush_whole_cache(dev);
+		if (yaffs_checkpoint_save(dev))
+			dev->bg_checkpoints++;
+	}
+	yaffs_gross_unlock(dev);
+}
+
 /*
  * yaffs background thread functions .
  * yaffs_bg_thread_fn() the thread function
@@ -1622,6 +1666,8 @@ static int yaffs_bg_thread_fn(void *data)
 	unsigned long now = jiffies;
 	unsigned long next_dir_update = now;
 	unsigned long next_gc = now;
+	unsigned long last_write = now;
+	u32 last_page_writes = dev->n_page_writes;
 	unsigned long expires;
 	unsigned int urgency;
 
@@ -1641,25 +1687,37 @@ static int yaffs_bg_thread_fn(void *data)
 		if (try_to_freeze())
 			continue;
 
-		yaffs_gross_lock(dev);
-
 		now = jiffies;
 
 		if (time_after(now, next_dir_update) && yaffs_bg_enable) {
+			yaffs_gross_lock_bg(dev);
 			yaffs_update_dirty_dirs(dev);
+			yaffs_gross_unlock(dev);
 			next_dir_update = now + HZ;
 		}
 
+		/*
+		 * The dirty dir update and the gc pass are done under separate
+		 * lock holds so that foreground reads and writes queued on the
+		 * gross lock get in between them. Unless space is getting
+		 * tight, a gc pass is also put off while anyone is waiting.
+		 */
+		yaffs_gross_lock_bg(dev);
 		if (time_after(now, next_gc) && yaffs_bg_enable) {
 			if (!dev->is_checkpointed) {
 				urgency = yaffs_bg_gc_urgency(dev);
-				gc_result = yaffs_bg_gc(dev, urgency);
-				if (urgency > 1)
+				if (urgency < 2 && yaffs_gross_contended(dev)) {
+					dev->bg_gc_deferrals++;
 					next_gc = now + HZ / 20 + 1;
-				else if (urgency > 0)
-					next_gc = now + HZ / 10 + 1;
-				else
-					next_gc = now + HZ * 2;
+				} else {
+					gc_result = yaffs_bg_gc(dev, urgency);
+					if (urgency > 1)
+						next_gc = now + HZ / 20 + 1;
+					else if (urgency > 0)
+						next_gc = now + HZ / 10 + 1;
+					else
+						next_gc = now + HZ * 2;
+				}
 			} else	{
 			        /*
 				 * gc not running so set to next_dir_update
@@ -1669,6 +1727,21 @@ static int yaffs_bg_thread_fn(void *data)
                         }
 		}
 		yaffs_gross_unlock(dev);
+
+		/*
+		 * Write a checkpoint once the fs has been idle for a while so
+		 * that a reasonably recent one is there if we lose power
+		 * rather than being unmounted, saving the full scan on mount.
+		 */
+		if (dev->n_page_writes != last_page_writes) {
+			last_page_writes = dev->n_page_writes;
+			last_write = now;
+		} else if (yaffs_bg_checkpoint_idle && yaffs_bg_enable &&
+			   !dev->is_checkpointed &&
+			   time_after(now, last_write +
+				      yaffs_bg_checkpoint_idle * HZ)) {
+			yaffs_bg_checkpoint(dev);
+		}
 		expires = next_dir_update;
 		if (time_before(next_gc, expires))
 			expires = next_gc;
@@ -1985,6 +2058,9 @@ static void yaffs_put_super(struct super_block *sb)
 		yaffs_dev_to_lc(dev)->spare_buffer = NULL;
 	}
 
+	kfree(yaffs_dev_to_lc(dev)->block_spare_buffer);
+	yaffs_dev_to_lc(dev)->block_spare_buffer = NULL;
+
 	kfree(dev);
 }
 
@@ -2262,11 +2338,15 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 		param->read_chunk_tags_fn = nandmtd2_read_chunk_tags;
 		param->bad_block_fn = nandmtd2_mark_block_bad;
 		param->query_block_fn = nandmtd2_query_block;
+		param->read_block_tags_fn = nandmtd2_read_block_tags;
 		yaffs_dev_to_lc(dev)->spare_buffer =
 		                kmalloc(mtd->oobsize, GFP_NOFS);
 		param->is_yaffs2 = 1;
 		param->total_bytes_per_chunk = mtd->writesize;
 		param->chunks_per_block = mtd->erasesize / mtd->writesize;
+		/* Optional, the scan falls back to per-chunk reads without it */
+		yaffs_dev_to_lc(dev)->block_spare_buffer =
+		    kmalloc(mtd->oobavail * param->chunks_per_block, GFP_NOFS);
 		n_blocks = YCALCBLOCKS(mtd->size, mtd->erasesize);
 
 		param->start_block = 0;
@@ -2321,6 +2401,7 @@ static struct super_block *yaffs_internal_read_super(int yaffs_version,
 	param->remove_obj_fn = yaffs_remove_obj_callback;
 
 	mutex_init(&(yaffs_dev_to_lc(dev)->gross_lock));
+	atomic_set(&(yaffs_dev_to_lc(dev)->gross_waiters), 0);
 
 	yaffs_gross_lock(dev);
 
@@ -2446,8 +2527,24 @@ static char *yaffs_dump_dev_part0(char *buf, struct yaffs_dev *dev)
 	return buf;
 }
 
+/* Flash page writes per page written on behalf of the user, times 100.
+ * Everything except gc copies counts as a user write here.
+ */
+static unsigned yaffs_wr_amplification(struct yaffs_dev *dev)
+{
+	u32 user_writes = dev->n_page_writes - dev->n_gc_copies;
+	u64 ratio = (u64) dev->n_page_writes * 100;
+
+	if (!user_writes)
+		return 0;
+	do_div(ratio, user_writes);
+	return (unsigned)ratio;
+}
+
 static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 {
+	unsigned wr_amp = yaffs_wr_amplification(dev);
+
 	buf +=
 	    sprintf(buf, "data_bytes_per_chunk.. %d\n",
 		    dev->data_bytes_per_chunk);
@@ -2466,6 +2563,8 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 	buf += sprintf(buf, "n_page_reads.......... %u\n", dev->n_page_reads);
 	buf += sprintf(buf, "n_erasures............ %u\n", dev->n_erasures);
 	buf += sprintf(buf, "n_gc_copies........... %u\n", dev->n_gc_copies);
+	buf += sprintf(buf, "wr_amplification...... %u.%02u\n",
+		       wr_amp / 100, wr_amp % 100);
 	buf += sprintf(buf, "all_gcs............... %u\n", dev->all_gcs);
 	buf +=
 	    sprintf(buf, "passive_gc_count...... %u\n", dev->passive_gc_count);
@@ -2474,6 +2573,9 @@ static char *yaffs_dump_dev_part1(char *buf, struct yaffs_dev *dev)
 		    dev->oldest_dirty_gc_count);
 	buf += sprintf(buf, "n_gc_blocks........... %u\n", dev->n_gc_blocks);
 	buf += sprintf(buf, "bg_gcs................ %u\n", dev->bg_gcs);
+	buf +=
+	    sprintf(buf, "bg_gc_deferrals....... %u\n", dev->bg_gc_deferrals);
+	buf += sprintf(buf, "bg_checkpoints........ %u\n", dev->bg_checkpoints);
 	buf +=
 	    sprintf(buf, "n_retired_writes...... %u\n", dev->n_retired_writes);
 	buf +=
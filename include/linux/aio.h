@@ -145,6 +145,8 @@ struct kiocb {
 
 #define AIO_RING_MAGIC			0xa10a10a1
 #define AIO_RING_COMPAT_FEATURES	1
+/* ring->head is only ever advanced with cmpxchg(), userspace may reap too */
+#define AIO_RING_COMPAT_CMPXCHG_HEAD	2
 #define AIO_RING_INCOMPAT_FEATURES	0
 struct aio_ring {
 	unsigned	id;	/* kernel internal index number */
@@ -169,7 +171,6 @@ struct aio_ring_info {
 	unsigned long		mmap_size;
 
 	struct page		**ring_pages;
-	spinlock_t		ring_lock;
 	long			nr_pages;
 
 	unsigned		nr, tail;
@@ -95,6 +95,18 @@ struct backing_dev_info {
 	unsigned int min_ratio;
 	unsigned int max_ratio, max_prop_frac;
 
+	/*
+	 * Read latency feedback: the block layer folds every completed
+	 * read into @avg_read_latency (usecs, 1/8 weight moving average).
+	 * While it stays above @read_latency_target, dirtiers are paused
+	 * longer and background writeback backs off between batches.
+	 */
+	unsigned long read_latency_target;	/* usecs, 0 disables */
+	atomic_long_t avg_read_latency;
+	unsigned long read_latency_stamp;	/* last read completion */
+	atomic_long_t read_lat_throttled;	/* dirtier pauses stretched */
+	atomic_long_t read_lat_backoffs;	/* flusher back-offs */
+
 	struct bdi_writeback wb;  /* default writeback info for this bdi */
 	spinlock_t wb_lock;	  /* protects work_list */
 
@@ -215,6 +227,34 @@ static inline unsigned long bdi_stat_error(struct backing_dev_info *bdi)
 #endif
 }
 
+/*
+ * Fold a read completion into the moving average.  Reads complete on
+ * several CPUs at once, so the average is updated with cmpxchg.
+ */
+static inline void bdi_account_read_latency(struct backing_dev_info *bdi,
+					    unsigned long usecs)
+{
+	long old, new;
+
+	do {
+		old = atomic_long_read(&bdi->avg_read_latency);
+		new = old + ((long)usecs - old) / 8;
+	} while (atomic_long_cmpxchg(&bdi->avg_read_latency, old, new) != old);
+	bdi->read_latency_stamp = jiffies;
+}
+
+/*
+ * Foreground reads are suffering: the average is above target and has
+ * been refreshed within the last second.
+ */
+static inline bool bdi_read_latency_exceeded(struct backing_dev_info *bdi)
+{
+	return bdi->read_latency_target &&
+	       time_before(jiffies, ACCESS_ONCE(bdi->read_latency_stamp) + HZ) &&
+	       atomic_long_read(&bdi->avg_read_latency) >
+	       bdi->read_latency_target;
+}
+
 int bdi_set_min_ratio(struct backing_dev_info *bdi, unsigned int min_ratio);
 int bdi_set_max_ratio(struct backing_dev_info *bdi, unsigned int max_ratio);
 
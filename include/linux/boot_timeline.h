@@ -0,0 +1,26 @@
+#ifndef _LINUX_BOOT_TIMELINE_H
+#define _LINUX_BOOT_TIMELINE_H
+
+#include <linux/ktime.h>
+
+/*
+ * Boot timeline: start and end of every initcall and driver probe, with the
+ * thread that ran it, shown in debugfs as "boot_timeline".
+ */
+#ifdef CONFIG_BOOT_TIMELINE
+extern bool boot_timeline_enabled(void);
+extern void boot_timeline_record(const char *kind, const char *name,
+				 ktime_t start, int ret);
+#else
+static inline bool boot_timeline_enabled(void)
+{
+	return false;
+}
+
+static inline void boot_timeline_record(const char *kind, const char *name,
+					ktime_t start, int ret)
+{
+}
+#endif
+
+#endif /* _LINUX_BOOT_TIMELINE_H */
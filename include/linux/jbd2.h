@@ -620,11 +620,40 @@ struct transaction_run_stats_s {
 	__u32			rs_blocks_logged;
 };
 
+/*
+ * Commit phase latency histograms. Bucket 0 counts zero-length phases,
+ * bucket n (n > 0) counts phases of [2^(n-1), 2^n) time units, with the
+ * last bucket catching everything longer.
+ */
+enum {
+	JBD2_HIST_LOCKED,	/* ms waiting for handles to finish */
+	JBD2_HIST_FLUSHING,	/* ms writing ordered data */
+	JBD2_HIST_LOGGING,	/* ms writing the journal blocks */
+	JBD2_HIST_COMMIT,	/* us for the whole commit */
+	JBD2_HIST_NR,
+};
+#define JBD2_HIST_BUCKETS	16
+
 struct transaction_stats_s {
 	unsigned long		ts_tid;
 	struct transaction_run_stats_s run;
 };
 
+/* Kept only in the journal, not in the per-commit stats on the stack */
+struct jbd2_stats_hist {
+	__u32			h[JBD2_HIST_NR][JBD2_HIST_BUCKETS];
+};
+
+static inline void jbd2_hist_add(struct jbd2_stats_hist *hist,
+				 int which, unsigned long val)
+{
+	int bucket = val ? fls_long(val) : 0;
+
+	if (bucket >= JBD2_HIST_BUCKETS)
+		bucket = JBD2_HIST_BUCKETS - 1;
+	hist->h[which][bucket]++;
+}
+
 static inline unsigned long
 jbd2_time_diff(unsigned long start, unsigned long end)
 {
@@ -703,6 +732,7 @@ jbd2_time_diff(unsigned long start, unsigned long end)
  * @j_history_lock: Protect the transactions statistics history
  * @j_proc_entry: procfs entry for the jbd statistics directory
  * @j_stats: Overall statistics
+ * @j_stats_hist: Commit phase latency histograms
  * @j_private: An opaque pointer to fs-private information.
  */
 
@@ -931,6 +961,7 @@ struct journal_s
 	spinlock_t		j_history_lock;
 	struct proc_dir_entry	*j_proc_entry;
 	struct transaction_stats_s j_stats;
+	struct jbd2_stats_hist	j_stats_hist;
 
 	/* Failed journal commit ID */
 	unsigned int		j_failed_commit;
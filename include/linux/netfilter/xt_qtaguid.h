@@ -10,4 +10,59 @@
 #define XT_QTAGUID_SOCKET XT_OWNER_SOCKET
 #define xt_qtaguid_match_info xt_owner_match_info
 
+#include <linux/if.h>
+#include <linux/types.h>
+
+/*
+ * Binary form of /proc/net/xt_qtaguid/stats, read from
+ * /proc/net/xt_qtaguid/stats_bin: a qtaguid_stats_hdr followed by
+ * nr_entries records of entry_size bytes, sorted by
+ * {iface, acct_tag, uid, cnt_set}.  Readers must use hdr_size and
+ * entry_size to step through the data so that fields can be appended
+ * in later versions.
+ *
+ * Every read at offset 0 takes a new snapshot.  After the first one,
+ * a snapshot on the same open file only holds the entries that changed
+ * since the previous one (QTAGUID_STATS_F_DELTA), and the entries that
+ * were deleted since then, with QTAGUID_STATS_ENTRY_F_DELETED set and
+ * their last counters; counters are always absolute.
+ */
+#define QTAGUID_STATS_MAGIC	0x71746773	/* "qtgs" */
+#define QTAGUID_STATS_VERSION	2
+
+#define QTAGUID_STATS_F_DELTA	(1 << 0)
+
+#define QTAGUID_STATS_ENTRY_F_DELETED	(1 << 0)
+
+enum {
+	QTAGUID_PROTO_TCP,
+	QTAGUID_PROTO_UDP,
+	QTAGUID_PROTO_OTHER,
+	QTAGUID_PROTO_MAX
+};
+
+struct qtaguid_stats_hdr {
+	__u32 magic;
+	__u16 version;
+	__u16 hdr_size;
+	__u32 entry_size;
+	__u32 nr_entries;
+	__u32 flags;
+	__u32 pad;
+};
+
+struct qtaguid_stats_entry {
+	char iface[IFNAMSIZ];
+	__u64 acct_tag;
+	__u32 uid;
+	__u32 cnt_set;
+	__u64 rx_bytes[QTAGUID_PROTO_MAX];
+	__u64 rx_packets[QTAGUID_PROTO_MAX];
+	__u64 tx_bytes[QTAGUID_PROTO_MAX];
+	__u64 tx_packets[QTAGUID_PROTO_MAX];
+	/* Since version 2 */
+	__u32 flags;
+	__u32 pad;
+};
+
 #endif /* _XT_QTAGUID_MATCH_H */
@@ -141,6 +141,7 @@ void pipe_double_lock(struct pipe_inode_info *, struct pipe_inode_info *);
 
 extern unsigned int pipe_max_size, pipe_min_size;
 int pipe_proc_fn(struct ctl_table *, int, void __user *, size_t *, loff_t *);
+void pipe_grow_private(struct pipe_inode_info *, unsigned int);
 
 
 /* Drop the inode semaphore and wait for a pipe event, atomically */
@@ -425,6 +425,8 @@ struct sk_buff {
 				ip_summed:2,
 				nohdr:1,
 				nfctinfo:3;
+	/* pkt_type is a bitfield; BPF JITs locate it through this marker */
+	__u8			__pkt_type_offset[0];
 	__u8			pkt_type:3,
 				fclone:2,
 				ipvs_property:1,
@@ -2094,6 +2096,11 @@ static inline void skb_frag_add_head(struct sk_buff *skb, struct sk_buff *frag)
 #define skb_walk_frags(skb, iter)	\
 	for (iter = skb_shinfo(skb)->frag_list; iter; iter = iter->next)
 
+extern int	       __skb_wait_for_more_packets(struct sock *sk, int *err,
+						   long *timeo_p);
+extern struct sk_buff *__skb_try_recv_from_queue(struct sk_buff_head *queue,
+						 unsigned int flags,
+						 int *peeked, int *off);
 extern struct sk_buff *__skb_recv_datagram(struct sock *sk, unsigned flags,
 					   int *peeked, int *off, int *err);
 extern struct sk_buff *skb_recv_datagram(struct sock *sk, unsigned flags,
@@ -2119,6 +2126,10 @@ extern int	       skb_copy_datagram_const_iovec(const struct sk_buff *from,
 extern void	       skb_free_datagram(struct sock *sk, struct sk_buff *skb);
 extern void	       skb_free_datagram_locked(struct sock *sk,
 						struct sk_buff *skb);
+extern int	       __skb_kill_datagram(struct sock *sk,
+					   struct sk_buff_head *queue,
+					   struct sk_buff *skb,
+					   unsigned int flags);
 extern int	       skb_kill_datagram(struct sock *sk, struct sk_buff *skb,
 					 unsigned int flags);
 extern __wsum	       skb_checksum(const struct sk_buff *skb, int offset,
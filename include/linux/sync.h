@@ -88,7 +88,8 @@ struct sync_timeline_ops {
  * @child_list_lock:	lock protecting @child_list_head, destroyed, and
  *			  sync_pt.status
  * @active_list_head:	list of active (unsignaled/errored) sync_pts
- * @sync_timeline_list:	membership in global sync_timeline_list
+ * @sync_timeline_list:	membership in global sync_timeline_list, only used
+ *			  when sync.debug_lists is set
  */
 struct sync_timeline {
 	struct kref		kref;
@@ -137,17 +138,21 @@ struct sync_pt {
 
 /**
  * struct sync_fence - sync fence
- * @file:		file representing this fence
- * @kref:		referenace count on fence.
+ * @file:		file representing this fence.  NULL until the fence is
+ *			  installed into a file descriptor
+ * @kref:		referenace count on fence.  An installed fence's file
+ *			  holds one reference
  * @name:		name of sync_fence.  Useful for debugging
  * @pt_list_head:	list of sync_pts in ths fence.  immutable once fence
  *			  is created
  * @waiter_list_head:	list of asynchronous waiters on this fence
  * @waiter_list_lock:	lock protecting @waiter_list_head and @status
  * @status:		1: signaled, 0:active, <0: error
+ * @pending:		number of sync_pts that have yet to signal
  *
  * @wq:			wait queue for fence signaling
- * @sync_fence_list:	membership in global fence list
+ * @sync_fence_list:	membership in global fence list, only used when
+ *			  sync.debug_lists is set
  */
 struct sync_fence {
 	struct file		*file;
@@ -160,6 +165,7 @@ struct sync_fence {
 	struct list_head	waiter_list_head;
 	spinlock_t		waiter_list_lock; /* also protects status */
 	int			status;
+	atomic_t		pending;
 
 	wait_queue_head_t	wq;
 
@@ -274,8 +280,8 @@ struct sync_fence *sync_fence_merge(const char *name,
  * sync_fence_fdget() - get a fence from an fd
  * @fd:		fd referencing a fence
  *
- * Ensures @fd references a valid fence, increments the refcount of the backing
- * file, and returns the fence.
+ * Ensures @fd references a valid fence, takes a reference on the fence, and
+ * returns it.  The reference must be dropped with sync_fence_put().
  */
 struct sync_fence *sync_fence_fdget(int fd);
 
@@ -294,8 +300,11 @@ void sync_fence_put(struct sync_fence *fence);
  * @fd:		file descriptor in which to install the fence
  *
  * Installs @fence into @fd.  @fd's should be acquired through get_unused_fd().
+ * The file backing the fence is created here, so fences which are only used
+ * inside the kernel never get one.  On success the caller's reference is
+ * transferred to @fd; on failure the caller still owns it.
  */
-void sync_fence_install(struct sync_fence *fence, int fd);
+int sync_fence_install(struct sync_fence *fence, int fd);
 
 /**
  * sync_fence_wait_async() - registers and async wait on the fence
@@ -302,6 +302,9 @@ struct tcp_sock {
 	u16	tcp_header_len;	/* Bytes of tcp header to send		*/
 	u16	xmit_size_goal_segs; /* Goal for segmenting output packets */
 
+	unsigned long	tsq_flags;	/* TCP Small Queues state, see TSQ_*	*/
+	struct list_head tsq_node;	/* anchor in tsq_tasklet.head list	*/
+
 /*
  *	Header prediction flags
  *	0x5?10 << 16 + snd_wnd in net byte order
@@ -474,6 +477,12 @@ struct tcp_sock {
 	struct tcp_cookie_values  *cookie_values;
 };
 
+enum tsq_flags {
+	TSQ_THROTTLED,		/* tcp_write_xmit() hit the in-queue limit */
+	TSQ_QUEUED,		/* socket is on this cpu's tsq_tasklet list */
+	TCP_TSQ_DEFERRED,	/* tcp_tasklet_func() found socket was owned */
+};
+
 static inline struct tcp_sock *tcp_sk(const struct sock *sk)
 {
 	return (struct tcp_sock *)sk;
@@ -81,6 +81,15 @@ struct udp_sock {
 	 * For encapsulation sockets.
 	 */
 	int (*encap_rcv)(struct sock *sk, struct sk_buff *skb);
+	/*
+	 * Datagrams moved off sk_receive_queue in one batch for the reader,
+	 * and those already read but not yet uncharged from the socket.
+	 * consumed_queue and consumed_truesize are protected by
+	 * reader_queue.lock.
+	 */
+	struct sk_buff_head	reader_queue;
+	struct sk_buff_head	consumed_queue;
+	unsigned int		consumed_truesize;
 };
 
 static inline struct udp_sock *udp_sk(const struct sock *sk)
@@ -16,10 +16,25 @@
 #ifndef __activity_stats_h
 #define __activity_stats_h
 
+#include <linux/types.h>
+
+struct net_device;
+
+enum activity_stats_dir {
+	ACTIVITY_STATS_TX,
+	ACTIVITY_STATS_RX,
+	ACTIVITY_STATS_DIRS,
+};
+
 #ifdef CONFIG_NET_ACTIVITY_STATS
 void activity_stats_update(void);
+void activity_stats_uid_update(uid_t uid, const struct net_device *dev,
+			       enum activity_stats_dir dir);
 #else
 #define activity_stats_update(void) {}
+static inline void activity_stats_uid_update(uid_t uid,
+					     const struct net_device *dev,
+					     enum activity_stats_dir dir) {}
 #endif
 
 #endif /* _NET_ACTIVITY_STATS_H */
@@ -105,6 +105,8 @@ struct rt_cache_stat {
         unsigned int gc_dst_overflow;
         unsigned int in_hlist_search;
         unsigned int out_hlist_search;
+        unsigned int out_pcpu_hit;
+        unsigned int in_pcpu_hit;
 };
 
 extern struct ip_rt_acct __percpu *ip_rt_acct;
@@ -28,6 +28,7 @@
 #include <linux/kmod.h>
 #include <linux/vmalloc.h>
 #include <linux/kernel_stat.h>
+#include <linux/boot_timeline.h>
 #include <linux/start_kernel.h>
 #include <linux/security.h>
 #include <linux/smp.h>
@@ -676,13 +677,25 @@ static int __init_or_module do_one_initcall_debug(initcall_t fn)
 int __init_or_module do_one_initcall(initcall_t fn)
 {
 	int count = preempt_count();
+	bool timeline = boot_timeline_enabled();
+	ktime_t uninitialized_var(start);
 	int ret;
 
+	if (timeline)
+		start = ktime_get();
+
 	if (initcall_debug)
 		ret = do_one_initcall_debug(fn);
 	else
 		ret = fn();
 
+	if (timeline) {
+		char name[KSYM_NAME_LEN];
+
+		snprintf(name, sizeof(name), "%pf", fn);
+		boot_timeline_record("initcall", name, start, ret);
+	}
+
 	msgbuf[0] = 0;
 
 	if (ret && ret != -ENODEV && initcall_debug)
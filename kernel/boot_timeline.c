@@ -0,0 +1,108 @@
+/*
+ * kernel/boot_timeline.c - record initcalls and driver probes during boot.
+ *
+ * Each record holds the start and end time of one initcall or probe and the
+ * pid of the thread that ran it, so parallel probing shows up as overlapping
+ * intervals on different threads.  Records are kept in a fixed table, which
+ * stops filling once full.
+ *
+ * This file is released under the GPLv2.
+ */
+
+#include <linux/boot_timeline.h>
+#include <linux/debugfs.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/seq_file.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#define BOOT_TIMELINE_SIZE	2048
+
+struct boot_timeline_entry {
+	const char	*kind;
+	char		name[48];
+	pid_t		pid;
+	int		ret;
+	ktime_t		start;
+	ktime_t		end;
+};
+
+static struct boot_timeline_entry boot_timeline[BOOT_TIMELINE_SIZE];
+static unsigned int boot_timeline_count;
+static unsigned int boot_timeline_dropped;
+static DEFINE_SPINLOCK(boot_timeline_lock);
+
+bool boot_timeline_enabled(void)
+{
+	return boot_timeline_count < BOOT_TIMELINE_SIZE;
+}
+
+void boot_timeline_record(const char *kind, const char *name,
+			  ktime_t start, int ret)
+{
+	struct boot_timeline_entry *e;
+	ktime_t end = ktime_get();
+	unsigned long flags;
+
+	spin_lock_irqsave(&boot_timeline_lock, flags);
+	if (boot_timeline_count >= BOOT_TIMELINE_SIZE) {
+		boot_timeline_dropped++;
+		spin_unlock_irqrestore(&boot_timeline_lock, flags);
+		return;
+	}
+	e = &boot_timeline[boot_timeline_count++];
+	e->kind = kind;
+	strlcpy(e->name, name, sizeof(e->name));
+	e->pid = task_pid_nr(current);
+	e->ret = ret;
+	e->start = start;
+	e->end = end;
+	spin_unlock_irqrestore(&boot_timeline_lock, flags);
+}
+
+static int boot_timeline_show(struct seq_file *s, void *unused)
+{
+	unsigned int i, count;
+
+	spin_lock_irq(&boot_timeline_lock);
+	count = boot_timeline_count;
+	spin_unlock_irq(&boot_timeline_lock);
+
+	/* Records below count are never rewritten, no need to hold the lock */
+	seq_printf(s, "%12s %12s %10s %6s %5s %-8s %s\n", "start_us", "end_us",
+		   "usecs", "pid", "ret", "kind", "name");
+	for (i = 0; i < count; i++) {
+		struct boot_timeline_entry *e = &boot_timeline[i];
+
+		seq_printf(s, "%12lld %12lld %10lld %6d %5d %-8s %s\n",
+			   (long long)ktime_to_us(e->start),
+			   (long long)ktime_to_us(e->end),
+			   (long long)ktime_us_delta(e->end, e->start),
+			   e->pid, e->ret, e->kind, e->name);
+	}
+	if (boot_timeline_dropped)
+		seq_printf(s, "# %u records dropped\n", boot_timeline_dropped);
+	return 0;
+}
+
+static int boot_timeline_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, boot_timeline_show, inode->i_private);
+}
+
+static const struct file_operations boot_timeline_fops = {
+	.open           = boot_timeline_open,
+	.read           = seq_read,
+	.llseek         = seq_lseek,
+	.release        = single_release,
+};
+
+static int __init boot_timeline_debugfs_init(void)
+{
+	debugfs_create_file("boot_timeline", S_IRUGO, NULL, NULL,
+			    &boot_timeline_fops);
+	return 0;
+}
+late_initcall(boot_timeline_debugfs_init);
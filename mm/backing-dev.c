@@ -100,6 +100,10 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   "BdiDirtied:         %10lu kB\n"
 		   "BdiWritten:         %10lu kB\n"
 		   "BdiWriteBandwidth:  %10lu kBps\n"
+		   "ReadLatency:        %10lu us\n"
+		   "ReadLatencyTarget:  %10lu us\n"
+		   "ReadLatThrottled:   %10lu\n"
+		   "ReadLatBackoffs:    %10lu\n"
 		   "b_dirty:            %10lu\n"
 		   "b_io:               %10lu\n"
 		   "b_more_io:          %10lu\n"
@@ -113,6 +117,10 @@ static int bdi_debug_stats_show(struct seq_file *m, void *v)
 		   (unsigned long) K(bdi_stat(bdi, BDI_DIRTIED)),
 		   (unsigned long) K(bdi_stat(bdi, BDI_WRITTEN)),
 		   (unsigned long) K(bdi->write_bandwidth),
+		   atomic_long_read(&bdi->avg_read_latency),
+		   bdi->read_latency_target,
+		   atomic_long_read(&bdi->read_lat_throttled),
+		   atomic_long_read(&bdi->read_lat_backoffs),
 		   nr_dirty,
 		   nr_io,
 		   nr_more_io,
@@ -225,12 +233,30 @@ static ssize_t max_ratio_store(struct device *dev,
 }
 BDI_SHOW(max_ratio, bdi->max_ratio)
 
+static ssize_t read_latency_target_us_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct backing_dev_info *bdi = dev_get_drvdata(dev);
+	char *end;
+	unsigned long usecs;
+	ssize_t ret = -EINVAL;
+
+	usecs = simple_strtoul(buf, &end, 10);
+	if (*buf && (end[0] == '\0' || (end[0] == '\n' && end[1] == '\0'))) {
+		bdi->read_latency_target = usecs;
+		ret = count;
+	}
+	return ret;
+}
+BDI_SHOW(read_latency_target_us, bdi->read_latency_target)
+
 #define __ATTR_RW(attr) __ATTR(attr, 0644, attr##_show, attr##_store)
 
 static struct device_attribute bdi_dev_attrs[] = {
 	__ATTR_RW(read_ahead_kb),
 	__ATTR_RW(min_ratio),
 	__ATTR_RW(max_ratio),
+	__ATTR_RW(read_latency_target_us),
 	__ATTR_NULL,
 };
 
@@ -700,6 +726,12 @@ int bdi_init(struct backing_dev_info *bdi)
 	bdi->write_bandwidth = INIT_BW;
 	bdi->avg_write_bandwidth = INIT_BW;
 
+	bdi->read_latency_target = 0;
+	atomic_long_set(&bdi->avg_read_latency, 0);
+	bdi->read_latency_stamp = jiffies - HZ;
+	atomic_long_set(&bdi->read_lat_throttled, 0);
+	atomic_long_set(&bdi->read_lat_backoffs, 0);
+
 	err = prop_local_init_percpu(&bdi->completions);
 
 	if (err) {
@@ -1279,6 +1279,14 @@ static void balance_dirty_pages(struct address_space *mapping,
 					       bdi_thresh, bdi_dirty);
 		task_ratelimit = ((u64)dirty_ratelimit * pos_ratio) >>
 							RATELIMIT_CALC_SHIFT;
+		/*
+		 * Reads on this device are waiting behind our writeback:
+		 * let the dirtier proceed at half its normal rate.
+		 */
+		if (bdi_read_latency_exceeded(bdi)) {
+			task_ratelimit /= 2;
+			atomic_long_inc(&bdi->read_lat_throttled);
+		}
 		max_pause = bdi_max_pause(bdi, bdi_dirty);
 		min_pause = bdi_min_pause(bdi, max_pause,
 					  task_ratelimit, dirty_ratelimit,
@@ -5662,7 +5662,11 @@ static int __alloc_contig_migrate_range(unsigned long start, unsigned long end)
 	};
 	INIT_LIST_HEAD(&cc.migratepages);
 
-	migrate_prep_local();
+	/*
+	 * Pages sitting in other CPUs' LRU pagevecs can't be isolated and
+	 * would make the whole range fail later, so drain them all first.
+	 */
+	migrate_prep();
 
 	while (pfn < end || !list_empty(&cc.migratepages)) {
 		if (fatal_signal_pending(current)) {
@@ -5682,6 +5686,15 @@ static int __alloc_contig_migrate_range(unsigned long start, unsigned long end)
 		} else if (++tries == 5) {
 			ret = ret < 0 ? ret : -EBUSY;
 			break;
+		} else if (tries == 2) {
+			/*
+			 * The remaining pages are pinned or under writeback.
+			 * Give their users one short moment instead of
+			 * spinning through the retries and failing the range;
+			 * waiting on every retry would stall the caller for
+			 * longer than trying another range.
+			 */
+			congestion_wait(BLK_RW_ASYNC, HZ/100);
 		}
 
 		ret = migrate_pages(&cc.migratepages,
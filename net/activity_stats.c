@@ -16,8 +16,15 @@
  * Author: Mike Chan (mike@android.com)
  */
 
+#include <linux/hash.h>
+#include <linux/jiffies.h>
+#include <linux/log2.h>
+#include <linux/netdevice.h>
+#include <linux/percpu.h>
 #include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 #include <linux/suspend.h>
+#include <net/activity_stats.h>
 #include <net/net_namespace.h>
 
 /*
@@ -35,6 +42,49 @@ static ktime_t last_transmit;
 static ktime_t suspend_time;
 static DEFINE_SPINLOCK(activity_lock);
 
+/*
+ * Per-uid attribution.
+ *
+ * Each interface remembers when it last carried a packet. Every packet
+ * then lands in a log2 histogram of that gap (1ms, 2ms, ... 2^19ms) for
+ * its {uid, interface, direction}, and a gap of at least one second is
+ * counted as a radio wakeup caused by that uid. Counters live in per-cpu
+ * tables only ever written by their own cpu with interrupts off, so the
+ * packet path takes no shared lock; readers sum the tables.
+ *
+ * Interfaces come and go all the time (tun, rmnet, clat), so an interface
+ * slot and all the uid entries for it are released when it unregisters.
+ * When a cpu's uid table is full, the least recently used entry near the
+ * new one's hash position is recycled.
+ */
+#define GAP_BUCKET_MAX	20
+#define WAKEUP_GAP_NS	NSEC_PER_SEC
+#define UID_SLOTS	128
+#define UID_EVICT_WINDOW	8
+#define IFACE_SLOTS	16
+
+struct activity_iface {
+	atomic_t ifindex;	/* 0 while the slot is free */
+	atomic64_t last_ns;
+};
+
+struct activity_uid_stat {
+	bool used;
+	uid_t uid;
+	int ifindex;
+	unsigned long last_used;	/* jiffies */
+	unsigned int wakeups[ACTIVITY_STATS_DIRS];
+	unsigned int gaps[ACTIVITY_STATS_DIRS][GAP_BUCKET_MAX];
+};
+
+struct activity_cpu_stats {
+	struct activity_uid_stat uid[UID_SLOTS];
+	unsigned int evicted;	/* entries recycled for a new uid */
+};
+
+static struct activity_iface activity_ifaces[IFACE_SLOTS];
+static DEFINE_PER_CPU(struct activity_cpu_stats, activity_cpu_stats);
+
 void activity_stats_update(void)
 {
 	int i;
@@ -61,6 +111,186 @@ void activity_stats_update(void)
 	spin_unlock_irqrestore(&activity_lock, flags);
 }
 
+static struct activity_iface *activity_iface_find(int ifindex)
+{
+	int i;
+
+	for (i = 0; i < IFACE_SLOTS; i++) {
+		struct activity_iface *iface = &activity_ifaces[i];
+		int cur = atomic_read(&iface->ifindex);
+
+		/* Claim a free slot; whoever wins may have been after ours */
+		if (!cur)
+			cur = atomic_cmpxchg(&iface->ifindex, 0, ifindex) ? :
+			      ifindex;
+		if (cur == ifindex)
+			return iface;
+	}
+	return NULL;
+}
+
+/* Returns the gap since the interface last saw traffic, or 0 if another
+ * cpu has just accounted for the same burst. */
+static s64 activity_iface_gap(struct activity_iface *iface, s64 now)
+{
+	s64 last = atomic64_read(&iface->last_ns);
+	s64 gap = now - last;
+
+	/* Sub-millisecond gaps all land in the first bucket anyway; don't
+	 * bounce the cacheline for them. */
+	if (gap < NSEC_PER_MSEC)
+		return gap;
+	if (atomic64_cmpxchg(&iface->last_ns, last, now) != last)
+		return 0;
+	return gap;
+}
+
+static inline unsigned int activity_uid_hash(uid_t uid, int ifindex)
+{
+	return hash_32(uid ^ ifindex, ilog2(UID_SLOTS));
+}
+
+static void activity_uid_claim(struct activity_uid_stat *s, uid_t uid,
+			       int ifindex)
+{
+	s->used = false;
+	smp_wmb();
+	s->uid = uid;
+	s->ifindex = ifindex;
+	memset(s->wakeups, 0, sizeof(s->wakeups));
+	memset(s->gaps, 0, sizeof(s->gaps));
+	smp_wmb();
+	s->used = true;
+}
+
+/* Linear probing from the hash position; never fails */
+static struct activity_uid_stat *
+activity_uid_slot(struct activity_cpu_stats *stats, uid_t uid, int ifindex)
+{
+	unsigned int h = activity_uid_hash(uid, ifindex);
+	struct activity_uid_stat *victim = NULL;
+	int i;
+
+	for (i = 0; i < UID_SLOTS; i++) {
+		struct activity_uid_stat *s;
+
+		s = &stats->uid[(h + i) & (UID_SLOTS - 1)];
+		if (!s->used) {
+			activity_uid_claim(s, uid, ifindex);
+			return s;
+		}
+		if (s->uid == uid && s->ifindex == ifindex)
+			return s;
+		if (i < UID_EVICT_WINDOW &&
+		    (!victim || time_before(s->last_used, victim->last_used)))
+			victim = s;
+	}
+
+	/* Recycling in place keeps the other probe chains intact */
+	stats->evicted++;
+	activity_uid_claim(victim, uid, ifindex);
+	return victim;
+}
+
+/*
+ * Drop this cpu's entries for an interface that went away. Runs on each
+ * cpu with interrupts off, so the packet path can't be in the table.
+ * Entries later in a probe chain are shifted back over the hole so that
+ * lookups never stop early.
+ */
+static void activity_uid_delete(struct activity_cpu_stats *stats,
+				unsigned int hole)
+{
+	unsigned int j, k;
+
+	for (j = (hole + 1) & (UID_SLOTS - 1);
+	     stats->uid[j].used && j != hole;
+	     j = (j + 1) & (UID_SLOTS - 1)) {
+		k = activity_uid_hash(stats->uid[j].uid, stats->uid[j].ifindex);
+		/* Can the entry at j move back to the hole? */
+		if (((j - k) & (UID_SLOTS - 1)) >=
+		    ((j - hole) & (UID_SLOTS - 1))) {
+			stats->uid[hole] = stats->uid[j];
+			hole = j;
+		}
+	}
+	stats->uid[hole].used = false;
+}
+
+static void activity_uid_forget(void *info)
+{
+	struct activity_cpu_stats *stats = &__get_cpu_var(activity_cpu_stats);
+	int ifindex = (long)info;
+	bool again;
+	unsigned int i;
+
+	/* A deletion may shift a matching entry back past i: rescan */
+	do {
+		again = false;
+		for (i = 0; i < UID_SLOTS; i++) {
+			if (stats->uid[i].used &&
+			    stats->uid[i].ifindex == ifindex) {
+				activity_uid_delete(stats, i);
+				again = true;
+			}
+		}
+	} while (again);
+}
+
+static void activity_iface_forget(int ifindex)
+{
+	int i;
+
+	for (i = 0; i < IFACE_SLOTS; i++) {
+		struct activity_iface *iface = &activity_ifaces[i];
+
+		if (atomic_read(&iface->ifindex) != ifindex)
+			continue;
+		atomic64_set(&iface->last_ns, 0);
+		atomic_cmpxchg(&iface->ifindex, ifindex, 0);
+	}
+	on_each_cpu(activity_uid_forget, (void *)(long)ifindex, 1);
+}
+
+void activity_stats_uid_update(uid_t uid, const struct net_device *dev,
+			       enum activity_stats_dir dir)
+{
+	struct activity_cpu_stats *stats;
+	struct activity_uid_stat *s;
+	struct activity_iface *iface;
+	unsigned long flags;
+	s64 gap;
+	int bucket;
+
+	/*
+	 * Unregistration marks the device before synchronize_net() and only
+	 * then sends NETDEV_UNREGISTER, so this keeps a packet still in
+	 * flight from claiming a slot again after activity_iface_forget().
+	 * Callers run under rcu_read_lock().
+	 */
+	if (dev->reg_state != NETREG_REGISTERED)
+		return;
+
+	iface = activity_iface_find(dev->ifindex);
+	if (!iface)
+		return;
+
+	gap = activity_iface_gap(iface, ktime_to_ns(ktime_get()));
+	bucket = gap < NSEC_PER_MSEC ? 0 :
+		 min_t(int, ilog2(div_s64(gap, NSEC_PER_MSEC)),
+		       GAP_BUCKET_MAX - 1);
+
+	local_irq_save(flags);
+	stats = &__get_cpu_var(activity_cpu_stats);
+	s = activity_uid_slot(stats, uid, dev->ifindex);
+	s->last_used = jiffies;
+	s->gaps[dir][bucket]++;
+	if (gap >= WAKEUP_GAP_NS)
+		s->wakeups[dir]++;
+	local_irq_restore(flags);
+}
+EXPORT_SYMBOL(activity_stats_uid_update);
+
 static int activity_stats_read_proc(char *page, char **start, off_t off,
 					int count, int *eof, void *data)
 {
@@ -92,9 +322,121 @@ static int activity_stats_read_proc(char *page, char **start, off_t off,
 	return p - page;
 }
 
+/* Has an earlier cpu already reported this {uid, ifindex}? */
+static bool activity_uid_seen(int upto_cpu, uid_t uid, int ifindex)
+{
+	int cpu, i;
+
+	for_each_possible_cpu(cpu) {
+		struct activity_cpu_stats *stats;
+
+		if (cpu >= upto_cpu)
+			break;
+		stats = &per_cpu(activity_cpu_stats, cpu);
+		for (i = 0; i < UID_SLOTS; i++) {
+			struct activity_uid_stat *s = &stats->uid[i];
+
+			if (s->used && s->uid == uid && s->ifindex == ifindex)
+				return true;
+		}
+	}
+	return false;
+}
+
+static void activity_uid_sum(struct activity_uid_stat *sum)
+{
+	int cpu, i, dir, b;
+
+	for_each_possible_cpu(cpu) {
+		struct activity_cpu_stats *stats = &per_cpu(activity_cpu_stats, cpu);
+
+		for (i = 0; i < UID_SLOTS; i++) {
+			struct activity_uid_stat *s = &stats->uid[i];
+
+			if (!s->used || s->uid != sum->uid ||
+			    s->ifindex != sum->ifindex)
+				continue;
+			for (dir = 0; dir < ACTIVITY_STATS_DIRS; dir++) {
+				sum->wakeups[dir] += s->wakeups[dir];
+				for (b = 0; b < GAP_BUCKET_MAX; b++)
+					sum->gaps[dir][b] += s->gaps[dir][b];
+			}
+		}
+	}
+}
+
+static int activity_uid_show(struct seq_file *m, void *v)
+{
+	static const char * const dir_names[] = { "tx", "rx" };
+	struct activity_uid_stat sum;
+	unsigned int evicted = 0;
+	int cpu, i, dir, b;
+
+	seq_puts(m, "uid iface dir wakeups");
+	for (b = 0; b < GAP_BUCKET_MAX; b++)
+		seq_printf(m, " %ums", 1U << b);
+	seq_putc(m, '\n');
+
+	rcu_read_lock();
+	for_each_possible_cpu(cpu) {
+		struct activity_cpu_stats *stats = &per_cpu(activity_cpu_stats, cpu);
+
+		evicted += stats->evicted;
+		for (i = 0; i < UID_SLOTS; i++) {
+			struct activity_uid_stat *s = &stats->uid[i];
+			struct net_device *dev;
+
+			if (!s->used)
+				continue;
+			smp_rmb();
+			if (activity_uid_seen(cpu, s->uid, s->ifindex))
+				continue;
+
+			memset(&sum, 0, sizeof(sum));
+			sum.uid = s->uid;
+			sum.ifindex = s->ifindex;
+			activity_uid_sum(&sum);
+
+			dev = dev_get_by_index_rcu(&init_net, sum.ifindex);
+			for (dir = 0; dir < ACTIVITY_STATS_DIRS; dir++) {
+				if (dev)
+					seq_printf(m, "%u %s", sum.uid, dev->name);
+				else
+					seq_printf(m, "%u if%d", sum.uid,
+						   sum.ifindex);
+				seq_printf(m, " %s %u", dir_names[dir],
+					   sum.wakeups[dir]);
+				for (b = 0; b < GAP_BUCKET_MAX; b++)
+					seq_printf(m, " %u", sum.gaps[dir][b]);
+				seq_putc(m, '\n');
+			}
+		}
+	}
+	rcu_read_unlock();
+
+	if (evicted)
+		seq_printf(m, "# %u entries evicted for newer uids\n", evicted);
+	return 0;
+}
+
+static int activity_uid_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, activity_uid_show, NULL);
+}
+
+static const struct file_operations activity_uid_fops = {
+	.owner		= THIS_MODULE,
+	.open		= activity_uid_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
 static int activity_stats_notifier(struct notifier_block *nb,
 					unsigned long event, void *dummy)
 {
+	int i;
+
 	switch (event) {
 		case PM_SUSPEND_PREPARE:
 			suspend_time = ktime_get_real();
@@ -103,6 +445,10 @@ static int activity_stats_notifier(struct notifier_block *nb,
 		case PM_POST_SUSPEND:
 			suspend_time = ktime_sub(ktime_get_real(), suspend_time);
 			last_transmit = ktime_sub(last_transmit, suspend_time);
+			/* Time asleep counts towards the next gap */
+			for (i = 0; i < IFACE_SLOTS; i++)
+				atomic64_sub(ktime_to_ns(suspend_time),
+					     &activity_ifaces[i].last_ns);
 	}
 
 	return 0;
@@ -112,10 +458,27 @@ static struct notifier_block activity_stats_notifier_block = {
 	.notifier_call = activity_stats_notifier,
 };
 
+static int activity_stats_netdev_event(struct notifier_block *nb,
+				       unsigned long event, void *ptr)
+{
+	struct net_device *dev = ptr;
+
+	if (event == NETDEV_UNREGISTER)
+		activity_iface_forget(dev->ifindex);
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block activity_stats_netdev_notifier = {
+	.notifier_call = activity_stats_netdev_event,
+};
+
 static int  __init activity_stats_init(void)
 {
 	create_proc_read_entry("activity", S_IRUGO,
 			init_net.proc_net_stat, activity_stats_read_proc, NULL);
+	proc_create("activity_uid", S_IRUGO, init_net.proc_net_stat,
+		    &activity_uid_fops);
+	register_netdevice_notifier(&activity_stats_netdev_notifier);
 	return register_pm_notifier(&activity_stats_notifier_block);
 }
 
@@ -80,7 +80,7 @@ static int receiver_wake_function(wait_queue_t *wait, unsigned mode, int sync,
 /*
  * Wait for a packet..
  */
-static int wait_for_packet(struct sock *sk, int *err, long *timeo_p)
+int __skb_wait_for_more_packets(struct sock *sk, int *err, long *timeo_p)
 {
 	int error;
 	DEFINE_WAIT_FUNC(wait, receiver_wake_function);
@@ -126,6 +126,43 @@ out_noerr:
 	error = 1;
 	goto out;
 }
+EXPORT_SYMBOL(__skb_wait_for_more_packets);
+
+/**
+ *	__skb_try_recv_from_queue - take a datagram off a locked queue
+ *	@queue: queue to look at, its lock must be held by the caller
+ *	@flags: MSG_ flags
+ *	@peeked: returns non-zero if this packet has been seen before
+ *	@off: an offset in bytes to peek skb from. Returns an offset
+ *	      within an skb where data actually starts
+ *
+ *	Unlinks the first datagram, or with MSG_PEEK takes an extra
+ *	reference on the datagram at @off. Returns NULL if the queue
+ *	holds nothing suitable.
+ */
+struct sk_buff *__skb_try_recv_from_queue(struct sk_buff_head *queue,
+					  unsigned int flags,
+					  int *peeked, int *off)
+{
+	struct sk_buff *skb;
+
+	skb_queue_walk(queue, skb) {
+		*peeked = skb->peeked;
+		if (flags & MSG_PEEK) {
+			if (*off >= skb->len && skb->len) {
+				*off -= skb->len;
+				continue;
+			}
+			skb->peeked = 1;
+			atomic_inc(&skb->users);
+		} else
+			__skb_unlink(skb, queue);
+
+		return skb;
+	}
+	return NULL;
+}
+EXPORT_SYMBOL(__skb_try_recv_from_queue);
 
 /**
  *	__skb_recv_datagram - Receive a datagram skbuff
@@ -184,29 +221,17 @@ struct sk_buff *__skb_recv_datagram(struct sock *sk, unsigned flags,
 		struct sk_buff_head *queue = &sk->sk_receive_queue;
 
 		spin_lock_irqsave(&queue->lock, cpu_flags);
-		skb_queue_walk(queue, skb) {
-			*peeked = skb->peeked;
-			if (flags & MSG_PEEK) {
-				if (*off >= skb->len && skb->len) {
-					*off -= skb->len;
-					continue;
-				}
-				skb->peeked = 1;
-				atomic_inc(&skb->users);
-			} else
-				__skb_unlink(skb, queue);
-
-			spin_unlock_irqrestore(&queue->lock, cpu_flags);
-			return skb;
-		}
+		skb = __skb_try_recv_from_queue(queue, flags, peeked, off);
 		spin_unlock_irqrestore(&queue->lock, cpu_flags);
+		if (skb)
+			return skb;
 
 		/* User doesn't want to wait */
 		error = -EAGAIN;
 		if (!timeo)
 			goto no_packet;
 
-	} while (!wait_for_packet(sk, err, &timeo));
+	} while (!__skb_wait_for_more_packets(sk, err, &timeo));
 
 	return NULL;
 
@@ -254,8 +279,9 @@ void skb_free_datagram_locked(struct sock *sk, struct sk_buff *skb)
 EXPORT_SYMBOL(skb_free_datagram_locked);
 
 /**
- *	skb_kill_datagram - Free a datagram skbuff forcibly
+ *	__skb_kill_datagram - Free a datagram skbuff forcibly
  *	@sk: socket
+ *	@queue: queue the datagram was received from
  *	@skb: datagram skbuff
  *	@flags: MSG_ flags
  *
@@ -263,30 +289,31 @@ EXPORT_SYMBOL(skb_free_datagram_locked);
  *	skb_recv_datagram.  The flags argument must match the one
  *	used for skb_recv_datagram.
  *
- *	If the MSG_PEEK flag is set, and the packet is still on the
- *	receive queue of the socket, it will be taken off the queue
- *	before it is freed.
+ *	If the MSG_PEEK flag is set, and the packet is still on
+ *	@queue, it will be taken off the queue before it is freed.
+ *	skb_kill_datagram() does this for the socket receive queue.
  *
  *	This function currently only disables BH when acquiring the
- *	sk_receive_queue lock.  Therefore it must not be used in a
+ *	queue lock.  Therefore it must not be used in a
  *	context where that lock is acquired in an IRQ context.
  *
  *	It returns 0 if the packet was removed by us.
  */
 
-int skb_kill_datagram(struct sock *sk, struct sk_buff *skb, unsigned int flags)
+int __skb_kill_datagram(struct sock *sk, struct sk_buff_head *queue,
+			struct sk_buff *skb, unsigned int flags)
 {
 	int err = 0;
 
 	if (flags & MSG_PEEK) {
 		err = -ENOENT;
-		spin_lock_bh(&sk->sk_receive_queue.lock);
-		if (skb == skb_peek(&sk->sk_receive_queue)) {
-			__skb_unlink(skb, &sk->sk_receive_queue);
+		spin_lock_bh(&queue->lock);
+		if (skb == skb_peek(queue)) {
+			__skb_unlink(skb, queue);
 			atomic_dec(&skb->users);
 			err = 0;
 		}
-		spin_unlock_bh(&sk->sk_receive_queue.lock);
+		spin_unlock_bh(&queue->lock);
 	}
 
 	kfree_skb(skb);
@@ -295,6 +322,12 @@ int skb_kill_datagram(struct sock *sk, struct sk_buff *skb, unsigned int flags)
 
 	return err;
 }
+EXPORT_SYMBOL(__skb_kill_datagram);
+
+int skb_kill_datagram(struct sock *sk, struct sk_buff *skb, unsigned int flags)
+{
+	return __skb_kill_datagram(sk, &sk->sk_receive_queue, skb, flags);
+}
 EXPORT_SYMBOL(skb_kill_datagram);
 
 /**
@@ -89,6 +89,7 @@
 #include <linux/netfilter_ipv4.h>
 #include <linux/random.h>
 #include <linux/jhash.h>
+#include <linux/cpu.h>
 #include <linux/rcupdate.h>
 #include <linux/times.h>
 #include <linux/slab.h>
@@ -511,12 +512,12 @@ static int rt_cpu_seq_show(struct seq_file *seq, void *v)
 	struct rt_cache_stat *st = v;
 
 	if (v == SEQ_START_TOKEN) {
-		seq_printf(seq, "entries  in_hit in_slow_tot in_slow_mc in_no_route in_brd in_martian_dst in_martian_src  out_hit out_slow_tot out_slow_mc  gc_total gc_ignored gc_goal_miss gc_dst_overflow in_hlist_search out_hlist_search\n");
+		seq_printf(seq, "entries  in_hit in_slow_tot in_slow_mc in_no_route in_brd in_martian_dst in_martian_src  out_hit out_slow_tot out_slow_mc  gc_total gc_ignored gc_goal_miss gc_dst_overflow in_hlist_search out_hlist_search out_pcpu_hit in_pcpu_hit\n");
 		return 0;
 	}
 
 	seq_printf(seq,"%08x  %08x %08x %08x %08x %08x %08x %08x "
-		   " %08x %08x %08x %08x %08x %08x %08x %08x %08x \n",
+		   " %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x %08x \n",
 		   dst_entries_get_slow(&ipv4_dst_ops),
 		   st->in_hit,
 		   st->in_slow_tot,
@@ -535,7 +536,9 @@ static int rt_cpu_seq_show(struct seq_file *seq, void *v)
 		   st->gc_goal_miss,
 		   st->gc_dst_overflow,
 		   st->in_hlist_search,
-		   st->out_hlist_search
+		   st->out_hlist_search,
+		   st->out_pcpu_hit,
+		   st->in_pcpu_hit
 		);
 	return 0;
 }
@@ -2430,13 +2433,141 @@ martian_source_keep_err:
 	goto out;
 }
 
+/*
+ * Small per-cpu front end to the route cache, for both input and output
+ * lookups, so that a busy flow does not walk its hash chain for every
+ * packet.  A slot holds a reference on an rtable found in rt_hash_table
+ * and is trusted only while that entry is still current: rt_cache_flush()
+ * and every fib change bump rt_genid, which retires all slots at once
+ * without touching them, and entries dropped from the hash are caught by
+ * dst->obsolete.  A retired entry is released the next time its slot is
+ * looked at, or when a device is unregistered, so that nothing keeps the
+ * loopback device of a dying netns pinned.
+ *
+ * Slots are only ever touched by their own cpu with BHs disabled, except
+ * for those of an offline cpu, so no atomics or RCU callbacks are needed.
+ */
+#define RT_PCPU_CACHE_SLOTS	16
+
+static DEFINE_PER_CPU(struct rtable *[RT_PCPU_CACHE_SLOTS], rt_pcpu_cache);
+
+static void rt_pcpu_drain_cpu(unsigned int cpu)
+{
+	struct rtable **slots = per_cpu(rt_pcpu_cache, cpu);
+	unsigned int i;
+
+	for (i = 0; i < RT_PCPU_CACHE_SLOTS; i++) {
+		if (slots[i]) {
+			dst_release(&slots[i]->dst);
+			slots[i] = NULL;
+		}
+	}
+}
+
+static void rt_pcpu_drain(struct work_struct *unused)
+{
+	local_bh_disable();
+	rt_pcpu_drain_cpu(smp_processor_id());
+	local_bh_enable();
+}
+
+/* Empty the slots of every cpu.  Sleeps. */
+static void rt_pcpu_flush(void)
+{
+	unsigned int cpu;
+
+	get_online_cpus();
+	for_each_possible_cpu(cpu)
+		if (!cpu_online(cpu))
+			rt_pcpu_drain_cpu(cpu);
+	put_online_cpus();
+	schedule_on_each_cpu(rt_pcpu_drain);
+}
+
+static int rt_pcpu_netdev_event(struct notifier_block *this,
+				unsigned long event, void *ptr)
+{
+	if (event == NETDEV_UNREGISTER)
+		rt_pcpu_flush();
+	return NOTIFY_DONE;
+}
+
+static struct notifier_block rt_pcpu_netdev_notifier = {
+	.notifier_call = rt_pcpu_netdev_event,
+};
+
+static inline unsigned int rt_pcpu_slot(__be32 daddr, __be32 saddr,
+					u32 key, u32 initval)
+{
+	return jhash_3words((__force u32)daddr, (__force u32)saddr, key,
+			    initval) & (RT_PCPU_CACHE_SLOTS - 1);
+}
+
+static inline bool rt_output_key_match(struct rtable *rth, struct net *net,
+				       const struct flowi4 *flp4)
+{
+	return rth->rt_key_dst == flp4->daddr &&
+	       rth->rt_key_src == flp4->saddr &&
+	       rt_is_output_route(rth) &&
+	       rth->rt_oif == flp4->flowi4_oif &&
+	       rth->rt_mark == flp4->flowi4_mark &&
+	       !((rth->rt_key_tos ^ flp4->flowi4_tos) &
+		 (IPTOS_RT_MASK | RTO_ONLINK)) &&
+	       net_eq(dev_net(rth->dst.dev), net) &&
+	       !rt_is_expired(rth);
+}
+
+static inline bool rt_input_key_match(struct rtable *rth, struct net *net,
+				      __be32 daddr, __be32 saddr, int iif,
+				      u8 tos, u32 mark)
+{
+	return (((__force u32)rth->rt_key_dst ^ (__force u32)daddr) |
+		((__force u32)rth->rt_key_src ^ (__force u32)saddr) |
+		(rth->rt_route_iif ^ iif) |
+		(rth->rt_key_tos ^ tos)) == 0 &&
+	       rth->rt_mark == mark &&
+	       net_eq(dev_net(rth->dst.dev), net) &&
+	       !rt_is_expired(rth);
+}
+
+/*
+ * Both helpers must be called with BHs disabled.  A retired entry found
+ * in the slot is released right away.
+ */
+static struct rtable *rt_pcpu_get(unsigned int slot)
+{
+	struct rtable **slotp = &__get_cpu_var(rt_pcpu_cache)[slot];
+	struct rtable *rth = *slotp;
+
+	if (rth && (rth->dst.obsolete > 0 || rt_is_expired(rth))) {
+		*slotp = NULL;
+		dst_release(&rth->dst);
+		rth = NULL;
+	}
+	return rth;
+}
+
+static void rt_pcpu_store(unsigned int slot, struct rtable *rth)
+{
+	struct rtable **slotp = &__get_cpu_var(rt_pcpu_cache)[slot];
+	struct rtable *old = *slotp;
+
+	if (old == rth)
+		return;
+	dst_hold(&rth->dst);
+	*slotp = rth;
+	if (old)
+		dst_release(&old->dst);
+}
+
 int ip_route_input_common(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 			   u8 tos, struct net_device *dev, bool noref)
 {
 	struct rtable * rth;
-	unsigned	hash;
+	unsigned	hash, slot = 0;
 	int iif = dev->ifindex;
 	struct net *net;
+	bool pcpu;
 	int res;
 
 	net = dev_net(dev);
@@ -2449,26 +2580,25 @@ int ip_route_input_common(struct sk_buff *skb, __be32 daddr, __be32 saddr,
 	tos &= IPTOS_RT_MASK;
 	hash = rt_hash(daddr, saddr, iif, rt_genid(net));
 
+	/* The per-cpu slots need BHs off, as on the normal receive path */
+	pcpu = in_softirq();
+	if (pcpu) {
+		slot = rt_pcpu_slot(daddr, saddr, iif ^ skb->mark, 1);
+		rth = rt_pcpu_get(slot);
+		if (rth && rt_input_key_match(rth, net, daddr, saddr, iif,
+					      tos, skb->mark)) {
+			RT_CACHE_STAT_INC(in_pcpu_hit);
+			goto hit;
+		}
+	}
+
 	for (rth = rcu_dereference(rt_hash_table[hash].chain); rth;
 	     rth = rcu_dereference(rth->dst.rt_next)) {
-		if ((((__force u32)rth->rt_key_dst ^ (__force u32)daddr) |
-		     ((__force u32)rth->rt_key_src ^ (__force u32)saddr) |
-		     (rth->rt_route_iif ^ iif) |
-		     (rth->rt_key_tos ^ tos)) == 0 &&
-		    rth->rt_mark == skb->mark &&
-		    net_eq(dev_net(rth->dst.dev), net) &&
-		    !rt_is_expired(rth)) {
-			ipv4_validate_peer(rth);
-			if (noref) {
-				dst_use_noref(&rth->dst, jiffies);
-				skb_dst_set_noref(skb, &rth->dst);
-			} else {
-				dst_use(&rth->dst, jiffies);
-				skb_dst_set(skb, &rth->dst);
-			}
-			RT_CACHE_STAT_INC(in_hit);
-			rcu_read_unlock();
-			return 0;
+		if (rt_input_key_match(rth, net, daddr, saddr, iif, tos,
+				       skb->mark)) {
+			if (pcpu)
+				rt_pcpu_store(slot, rth);
+			goto hit;
 		}
 		RT_CACHE_STAT_INC(in_hlist_search);
 	}
@@ -2510,6 +2640,19 @@ skip_cache:
 	res = ip_route_input_slow(skb, daddr, saddr, tos, dev);
 	rcu_read_unlock();
 	return res;
+
+hit:
+	ipv4_validate_peer(rth);
+	if (noref) {
+		dst_use_noref(&rth->dst, jiffies);
+		skb_dst_set_noref(skb, &rth->dst);
+	} else {
+		dst_use(&rth->dst, jiffies);
+		skb_dst_set(skb, &rth->dst);
+	}
+	RT_CACHE_STAT_INC(in_hit);
+	rcu_read_unlock();
+	return 0;
 }
 EXPORT_SYMBOL(ip_route_input_common);
 
@@ -2815,34 +2958,27 @@ out:
 struct rtable *__ip_route_output_key(struct net *net, struct flowi4 *flp4)
 {
 	struct rtable *rth;
-	unsigned int hash;
+	unsigned int hash, slot;
 
 	if (!rt_caching(net))
 		goto slow_output;
 
 	hash = rt_hash(flp4->daddr, flp4->saddr, flp4->flowi4_oif, rt_genid(net));
+	slot = rt_pcpu_slot(flp4->daddr, flp4->saddr,
+			    flp4->flowi4_oif ^ flp4->flowi4_mark, 0);
 
 	rcu_read_lock_bh();
+	rth = rt_pcpu_get(slot);
+	if (rth && rt_output_key_match(rth, net, flp4)) {
+		RT_CACHE_STAT_INC(out_pcpu_hit);
+		goto hit;
+	}
+
 	for (rth = rcu_dereference_bh(rt_hash_table[hash].chain); rth;
 		rth = rcu_dereference_bh(rth->dst.rt_next)) {
-		if (rth->rt_key_dst == flp4->daddr &&
-		    rth->rt_key_src == flp4->saddr &&
-		    rt_is_output_route(rth) &&
-		    rth->rt_oif == flp4->flowi4_oif &&
-		    rth->rt_mark == flp4->flowi4_mark &&
-		    !((rth->rt_key_tos ^ flp4->flowi4_tos) &
-			    (IPTOS_RT_MASK | RTO_ONLINK)) &&
-		    net_eq(dev_net(rth->dst.dev), net) &&
-		    !rt_is_expired(rth)) {
-			ipv4_validate_peer(rth);
-			dst_use(&rth->dst, jiffies);
-			RT_CACHE_STAT_INC(out_hit);
-			rcu_read_unlock_bh();
-			if (!flp4->saddr)
-				flp4->saddr = rth->rt_src;
-			if (!flp4->daddr)
-				flp4->daddr = rth->rt_dst;
-			return rth;
+		if (rt_output_key_match(rth, net, flp4)) {
+			rt_pcpu_store(slot, rth);
+			goto hit;
 		}
 		RT_CACHE_STAT_INC(out_hlist_search);
 	}
@@ -2850,6 +2986,17 @@ struct rtable *__ip_route_output_key(struct net *net, struct flowi4 *flp4)
 
 slow_output:
 	return ip_route_output_slow(net, flp4);
+
+hit:
+	ipv4_validate_peer(rth);
+	dst_use(&rth->dst, jiffies);
+	RT_CACHE_STAT_INC(out_hit);
+	rcu_read_unlock_bh();
+	if (!flp4->saddr)
+		flp4->saddr = rth->rt_src;
+	if (!flp4->daddr)
+		flp4->daddr = rth->rt_dst;
+	return rth;
 }
 EXPORT_SYMBOL_GPL(__ip_route_output_key);
 
@@ -3495,6 +3642,7 @@ int __init ip_rt_init(void)
 	register_pernet_subsys(&sysctl_route_ops);
 #endif
 	register_pernet_subsys(&rt_genid_ops);
+	register_netdevice_notifier(&rt_pcpu_netdev_notifier);
 	return rc;
 }
 
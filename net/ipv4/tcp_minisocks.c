@@ -502,6 +502,8 @@ struct sock *tcp_create_openreq_child(struct sock *sk, struct request_sock *req,
 		tcp_set_ca_state(newsk, TCP_CA_Open);
 		tcp_init_xmit_timers(newsk);
 		skb_queue_head_init(&newtp->out_of_order_queue);
+		newtp->tsq_flags = 0;
+		INIT_LIST_HEAD(&newtp->tsq_node);
 		newtp->write_seq = newtp->pushed_seq =
 			treq->snt_isn + 1 + tcp_s_data_size(oldtp);
 
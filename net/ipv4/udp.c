@@ -1085,6 +1085,148 @@ out:
 }
 
 
+int udp_init_sock(struct sock *sk)
+{
+	struct udp_sock *up = udp_sk(sk);
+
+	skb_queue_head_init(&up->reader_queue);
+	__skb_queue_head_init(&up->consumed_queue);
+	up->consumed_truesize = 0;
+	return 0;
+}
+EXPORT_SYMBOL(udp_init_sock);
+
+/* Called on destroy; the reader side is gone by now */
+void udp_purge_reader_queues(struct sock *sk)
+{
+	struct udp_sock *up = udp_sk(sk);
+
+	spin_lock_bh(&up->reader_queue.lock);
+	__skb_queue_purge(&up->reader_queue);
+	__skb_queue_purge(&up->consumed_queue);
+	up->consumed_truesize = 0;
+	spin_unlock_bh(&up->reader_queue.lock);
+}
+EXPORT_SYMBOL(udp_purge_reader_queues);
+
+/* Move everything queued by the softirq side to the reader queue in one
+ * go, so that a burst of datagrams costs a single sk_receive_queue lock.
+ * Caller holds reader_queue.lock with BHs disabled.
+ */
+static void udp_splice_receive_queue(struct sock *sk)
+{
+	struct sk_buff_head *sk_queue = &sk->sk_receive_queue;
+
+	if (skb_queue_empty(sk_queue))
+		return;
+
+	spin_lock_irq(&sk_queue->lock);
+	skb_queue_splice_tail_init(sk_queue, &udp_sk(sk)->reader_queue);
+	spin_unlock_irq(&sk_queue->lock);
+}
+
+/**
+ *	__skb_recv_udp - receive a datagram for a UDP socket
+ *	@sk: socket
+ *	@flags: MSG_ flags
+ *	@noblock: don't wait for a datagram
+ *	@peeked: returns non-zero if this packet has been seen before
+ *	@off: peek offset, see __skb_recv_datagram()
+ *	@err: error code returned
+ *
+ *	Like __skb_recv_datagram(), but serves datagrams from the reader
+ *	queue and only refills it, in bulk, once it runs empty.
+ */
+struct sk_buff *__skb_recv_udp(struct sock *sk, unsigned int flags,
+			       int noblock, int *peeked, int *off, int *err)
+{
+	struct sk_buff_head *queue = &udp_sk(sk)->reader_queue;
+	struct sk_buff *skb;
+	long timeo;
+	int error = sock_error(sk);
+
+	if (error)
+		goto no_packet;
+
+	timeo = sock_rcvtimeo(sk, noblock);
+
+	do {
+		spin_lock_bh(&queue->lock);
+		skb = __skb_try_recv_from_queue(queue, flags, peeked, off);
+		if (!skb) {
+			udp_splice_receive_queue(sk);
+			skb = __skb_try_recv_from_queue(queue, flags,
+							peeked, off);
+		}
+		spin_unlock_bh(&queue->lock);
+		if (skb)
+			return skb;
+
+		/* User doesn't want to wait */
+		error = -EAGAIN;
+		if (!timeo)
+			goto no_packet;
+
+	} while (!__skb_wait_for_more_packets(sk, err, &timeo));
+
+	return NULL;
+
+no_packet:
+	*err = error;
+	return NULL;
+}
+EXPORT_SYMBOL(__skb_recv_udp);
+
+/**
+ *	udp_skb_free - release a datagram returned by __skb_recv_udp()
+ *	@sk: socket
+ *	@skb: datagram
+ *
+ *	Read datagrams are parked until the reader queue drains and are
+ *	then uncharged from the socket under a single socket lock, rather
+ *	than taking the lock once per datagram.  At most a quarter of
+ *	sk_rcvbuf is held back this way, so small receive buffers don't
+ *	start dropping.
+ */
+void udp_skb_free(struct sock *sk, struct sk_buff *skb)
+{
+	struct udp_sock *up = udp_sk(sk);
+	struct sk_buff_head done;
+	bool slow;
+
+	/* A peeked datagram may still be on the reader queue */
+	if (unlikely(atomic_read(&skb->users) != 1)) {
+		skb_free_datagram_locked(sk, skb);
+		return;
+	}
+
+	__skb_queue_head_init(&done);
+
+	spin_lock_bh(&up->reader_queue.lock);
+	__skb_queue_tail(&up->consumed_queue, skb);
+	up->consumed_truesize += skb->truesize;
+	if (skb_queue_empty(&up->reader_queue) ||
+	    up->consumed_truesize >= (sk->sk_rcvbuf >> 2)) {
+		skb_queue_splice_init(&up->consumed_queue, &done);
+		up->consumed_truesize = 0;
+	}
+	spin_unlock_bh(&up->reader_queue.lock);
+
+	if (skb_queue_empty(&done))
+		return;
+
+	slow = lock_sock_fast(sk);
+	skb_queue_walk(&done, skb)
+		skb_orphan(skb);
+	sk_mem_reclaim_partial(sk);
+	unlock_sock_fast(sk, slow);
+
+	/* skbs are now orphaned, can be freed outside of locked section */
+	while ((skb = __skb_dequeue(&done)) != NULL)
+		consume_skb(skb);
+}
+EXPORT_SYMBOL(udp_skb_free);
+
 /**
  *	first_packet_length	- return length of first packet in receive queue
  *	@sk: socket
@@ -1094,13 +1236,15 @@ out:
  */
 static unsigned int first_packet_length(struct sock *sk)
 {
-	struct sk_buff_head list_kill, *rcvq = &sk->sk_receive_queue;
+	struct sk_buff_head list_kill, *rcvq = &udp_sk(sk)->reader_queue;
 	struct sk_buff *skb;
 	unsigned int res;
 
 	__skb_queue_head_init(&list_kill);
 
 	spin_lock_bh(&rcvq->lock);
+	if (skb_queue_empty(rcvq))
+		udp_splice_receive_queue(sk);
 	while ((skb = skb_peek(rcvq)) != NULL &&
 		udp_lib_checksum_complete(skb)) {
 		UDP_INC_STATS_BH(sock_net(sk), UDP_MIB_INERRORS,
@@ -1108,6 +1252,8 @@ static unsigned int first_packet_length(struct sock *sk)
 		atomic_inc(&sk->sk_drops);
 		__skb_unlink(skb, rcvq);
 		__skb_queue_tail(&list_kill, skb);
+		if (skb_queue_empty(rcvq))
+			udp_splice_receive_queue(sk);
 	}
 	res = skb ? skb->len : 0;
 	spin_unlock_bh(&rcvq->lock);
@@ -1186,8 +1332,8 @@ int udp_recvmsg(struct kiocb *iocb, struct sock *sk, struct msghdr *msg,
 		return ip_recv_error(sk, msg, len);
 
 try_again:
-	skb = __skb_recv_datagram(sk, flags | (noblock ? MSG_DONTWAIT : 0),
-				  &peeked, &off, &err);
+	skb = __skb_recv_udp(sk, flags, noblock || (flags & MSG_DONTWAIT),
+			     &peeked, &off, &err);
 	if (!skb)
 		goto out;
 
@@ -1245,13 +1391,13 @@ try_again:
 		err = ulen;
 
 out_free:
-	skb_free_datagram_locked(sk, skb);
+	udp_skb_free(sk, skb);
 out:
 	return err;
 
 csum_copy_err:
 	slow = lock_sock_fast(sk);
-	if (!skb_kill_datagram(sk, skb, flags))
+	if (!__skb_kill_datagram(sk, &udp_sk(sk)->reader_queue, skb, flags))
 		UDP_INC_STATS_USER(sock_net(sk), UDP_MIB_INERRORS, is_udplite);
 	unlock_sock_fast(sk, slow);
 
@@ -1722,6 +1868,7 @@ void udp_destroy_sock(struct sock *sk)
 	bool slow = lock_sock_fast(sk);
 	udp_flush_pending_frames(sk);
 	unlock_sock_fast(sk, slow);
+	udp_purge_reader_queues(sk);
 }
 
 /*
@@ -1909,6 +2056,10 @@ unsigned int udp_poll(struct file *file, struct socket *sock, poll_table *wait)
 	unsigned int mask = datagram_poll(file, sock, wait);
 	struct sock *sk = sock->sk;
 
+	/* datagram_poll() only knows about sk_receive_queue */
+	if (!skb_queue_empty(&udp_sk(sk)->reader_queue))
+		mask |= POLLIN | POLLRDNORM;
+
 	/* Check for false positives due to checksum errors */
 	if ((mask & POLLRDNORM) && !(file->f_flags & O_NONBLOCK) &&
 	    !(sk->sk_shutdown & RCV_SHUTDOWN) && !first_packet_length(sk))
@@ -1926,6 +2077,7 @@ struct proto udp_prot = {
 	.connect	   = ip4_datagram_connect,
 	.disconnect	   = udp_disconnect,
 	.ioctl		   = udp_ioctl,
+	.init		   = udp_init_sock,
 	.destroy	   = udp_destroy_sock,
 	.setsockopt	   = udp_setsockopt,
 	.getsockopt	   = udp_getsockopt,
@@ -15,12 +15,16 @@
 #define DEBUG
 
 #include <linux/file.h>
+#include <linux/hash.h>
 #include <linux/inetdevice.h>
 #include <linux/module.h>
 #include <linux/netfilter/x_tables.h>
 #include <linux/netfilter/xt_qtaguid.h>
 #include <linux/skbuff.h>
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
 #include <linux/workqueue.h>
+#include <net/activity_stats.h>
 #include <net/addrconf.h>
 #include <net/sock.h>
 #include <net/tcp.h>
@@ -49,6 +53,7 @@ static unsigned int proc_iface_perms = S_IRUGO;
 module_param_named(iface_perms, proc_iface_perms, uint, S_IRUGO | S_IWUSR);
 
 static struct proc_dir_entry *xt_qtaguid_stats_file;
+static struct proc_dir_entry *xt_qtaguid_stats_bin_file;
 static unsigned int proc_stats_perms = S_IRUGO;
 module_param_named(stats_perms, proc_stats_perms, uint, S_IRUGO | S_IWUSR);
 
@@ -189,15 +194,17 @@ static struct proc_dir_entry *iface_stat_fmt_procfile;
  * qtaguid_mt()
  *   account_for_uid()
  *     if_tag_stat_update()
- *       get_sock_stat()
- *         sock_tag_list_lock
- *       struct iface_stat->tag_stat_list_lock
- *         tag_stat_update()
- *           get_active_counter_set()
- *             tag_counter_set_list_lock
+ *       rcu_read_lock()
+ *         get_sock_stat()
+ *           (sock_tag_hash)
+ *         struct iface_stat->tag_stat_list_lock
+ *           only to create a tag_stat
+ *             tag_stat_alloc_lock
  *         tag_stat_update()
  *           get_active_counter_set()
- *             tag_counter_set_list_lock
+ *             (tag_counter_set_hash)
+ *           struct iface_stat->tag_stat_list_lock
+ *             only until the tag_stat has its per-cpu counters
  *
  *
  * qtaguid_ctrl_parse()
@@ -231,6 +238,23 @@ static DEFINE_SPINLOCK(sock_tag_list_lock);
 static struct rb_root tag_counter_set_tree = RB_ROOT;
 static DEFINE_SPINLOCK(tag_counter_set_list_lock);
 
+/*
+ * The packet path looks sock_tags, tag_counter_sets and tag_stats up in
+ * these hashes under rcu_read_lock() instead of taking the locks above.
+ * Entries are hashed and unhashed together with their tree nodes, under
+ * the same locks, and freed after a grace period.
+ */
+#define SOCK_TAG_HASH_BITS 8
+static struct hlist_head sock_tag_hash[1 << SOCK_TAG_HASH_BITS];
+#define TAG_COUNTER_SET_HASH_BITS 6
+static struct hlist_head tag_counter_set_hash[1 << TAG_COUNTER_SET_HASH_BITS];
+
+/* tag_stats waiting for tag_stat_alloc_worker() to add per-cpu counters */
+static LIST_HEAD(tag_stat_alloc_list);
+static DEFINE_SPINLOCK(tag_stat_alloc_lock);
+static void tag_stat_alloc_worker(struct work_struct *work);
+static DECLARE_WORK(tag_stat_alloc_work, tag_stat_alloc_worker);
+
 static struct rb_root uid_tag_data_tree = RB_ROOT;
 static DEFINE_SPINLOCK(uid_tag_data_tree_lock);
 
@@ -350,6 +374,26 @@ static struct tag_stat *tag_stat_tree_search(struct rb_root *root, tag_t tag)
 	return rb_entry(&node->node, struct tag_stat, tn.node);
 }
 
+/* Caller must hold rcu_read_lock() or the iface's tag_stat_list_lock */
+static struct tag_stat *tag_stat_hash_search(struct iface_stat *iface_entry,
+					     tag_t tag)
+{
+	struct hlist_head *head;
+	struct hlist_node *node;
+	struct tag_stat *ts;
+
+	head = &iface_entry->tag_stat_hash[hash_64(tag, TAG_STAT_HASH_BITS)];
+	hlist_for_each_entry_rcu(ts, node, head, hash_node)
+		if (ts->tn.tag == tag)
+			return ts;
+	return NULL;
+}
+
+static struct hlist_head *tag_counter_set_hash_head(tag_t tag)
+{
+	return &tag_counter_set_hash[hash_64(tag, TAG_COUNTER_SET_HASH_BITS)];
+}
+
 static void tag_counter_set_tree_insert(struct tag_counter_set *data,
 					struct rb_root *root)
 {
@@ -379,6 +423,11 @@ static struct tag_ref *tag_ref_tree_search(struct rb_root *root, tag_t tag)
 	return rb_entry(&node->node, struct tag_ref, tn.node);
 }
 
+static struct hlist_head *sock_tag_hash_head(const struct sock *sk)
+{
+	return &sock_tag_hash[hash_ptr((void *)sk, SOCK_TAG_HASH_BITS)];
+}
+
 static struct sock_tag *sock_tag_tree_search(struct rb_root *root,
 					     const struct sock *sk)
 {
@@ -435,7 +484,7 @@ static void sock_tag_tree_erase(struct rb_root *st_to_free_tree)
 			 get_uid_from_tag(st_entry->tag));
 		rb_erase(&st_entry->sock_node, st_to_free_tree);
 		sockfd_put(st_entry->socket);
-		kfree(st_entry);
+		kfree_rcu(st_entry, rcu);
 	}
 }
 
@@ -750,23 +799,28 @@ static int get_active_counter_set(tag_t tag)
 {
 	int active_set = 0;
 	struct tag_counter_set *tcs;
+	struct hlist_node *node;
 
 	MT_DEBUG("qtaguid: get_active_counter_set(tag=0x%llx)"
 		 " (uid=%u)\n",
 		 tag, get_uid_from_tag(tag));
 	/* For now we only handle UID tags for active sets */
 	tag = get_utag_from_tag(tag);
-	spin_lock_bh(&tag_counter_set_list_lock);
-	tcs = tag_counter_set_tree_search(&tag_counter_set_tree, tag);
-	if (tcs)
-		active_set = tcs->active_set;
-	spin_unlock_bh(&tag_counter_set_list_lock);
+	rcu_read_lock();
+	hlist_for_each_entry_rcu(tcs, node, tag_counter_set_hash_head(tag),
+				 hash_node)
+		if (tcs->tn.tag == tag) {
+			active_set = tcs->active_set;
+			break;
+		}
+	rcu_read_unlock();
 	return active_set;
 }
 
 /*
  * Find the entry for tracking the specified interface.
- * Caller must hold iface_stat_list_lock
+ * Caller must hold iface_stat_list_lock or rcu_read_lock().
+ * Entries are never deleted.
  */
 static struct iface_stat *get_iface_entry(const char *ifname)
 {
@@ -779,7 +833,7 @@ static struct iface_stat *get_iface_entry(const char *ifname)
 	}
 
 	/* Iterate over interfaces */
-	list_for_each_entry(iface_entry, &iface_stat_list, list) {
+	list_for_each_entry_rcu(iface_entry, &iface_stat_list, list) {
 		if (!strcmp(ifname, iface_entry->ifname))
 			goto done;
 	}
@@ -799,6 +853,7 @@ static int iface_stat_fmt_proc_read(char *page, char **num_items_returned,
 	struct iface_stat *iface_entry;
 	struct rtnl_link_stats64 dev_stats, *stats;
 	struct rtnl_link_stats64 no_dev_stats = {0};
+	struct byte_packet_counters totals_via_skb[IFS_MAX_DIRECTIONS];
 
 	if (unlikely(module_passive)) {
 		*eof = 1;
@@ -866,15 +921,16 @@ static int iface_stat_fmt_proc_read(char *page, char **num_items_returned,
 				stats->tx_bytes, stats->tx_packets
 				);
 		} else {
+			iface_sum_skb_totals(iface_entry, totals_via_skb);
 			len = snprintf(
 				outp, char_count,
 				"%s "
 				"%llu %llu %llu %llu\n",
 				iface_entry->ifname,
-				iface_entry->totals_via_skb[IFS_RX].bytes,
-				iface_entry->totals_via_skb[IFS_RX].packets,
-				iface_entry->totals_via_skb[IFS_TX].bytes,
-				iface_entry->totals_via_skb[IFS_TX].packets
+				totals_via_skb[IFS_RX].bytes,
+				totals_via_skb[IFS_RX].packets,
+				totals_via_skb[IFS_TX].bytes,
+				totals_via_skb[IFS_TX].packets
 				);
 		}
 		if (len >= char_count) {
@@ -898,6 +954,15 @@ static void iface_create_proc_worker(struct work_struct *work)
 	struct iface_stat_work *isw = container_of(work, struct iface_stat_work,
 						   iface_work);
 	struct iface_stat *new_iface  = isw->iface_entry;
+	struct iface_skb_totals_cpu __percpu *cpu_totals;
+
+	/* Can't be done from iface_alloc(), which may be atomic. */
+	cpu_totals = alloc_percpu(struct iface_skb_totals_cpu);
+	if (cpu_totals)
+		rcu_assign_pointer(new_iface->cpu_totals_via_skb, cpu_totals);
+	else
+		pr_err("qtaguid: iface_stat: create_proc(): "
+		       "skb totals alloc failed.\n");
 
 	/* iface_entries are not deleted, so safe to manipulate. */
 	proc_entry = proc_mkdir(new_iface->ifname, iface_stat_procdir);
@@ -994,7 +1059,7 @@ static struct iface_stat *iface_alloc(struct net_device *net_dev)
 	isw->iface_entry = new_iface;
 	INIT_WORK(&isw->iface_work, iface_create_proc_worker);
 	schedule_work(&isw->iface_work);
-	list_add(&new_iface->list, &iface_stat_list);
+	list_add_rcu(&new_iface->list, &iface_stat_list);
 	return new_iface;
 }
 
@@ -1175,16 +1240,19 @@ static struct sock_tag *get_sock_stat_nl(const struct sock *sk)
 	return sock_tag_tree_search(&sock_tag_tree, sk);
 }
 
+/* Caller must hold rcu_read_lock() */
 static struct sock_tag *get_sock_stat(const struct sock *sk)
 {
 	struct sock_tag *sock_tag_entry;
+	struct hlist_node *node;
 	MT_DEBUG("qtaguid: get_sock_stat(sk=%p)\n", sk);
 	if (!sk)
 		return NULL;
-	spin_lock_bh(&sock_tag_list_lock);
-	sock_tag_entry = get_sock_stat_nl(sk);
-	spin_unlock_bh(&sock_tag_list_lock);
-	return sock_tag_entry;
+	hlist_for_each_entry_rcu(sock_tag_entry, node, sock_tag_hash_head(sk),
+				 hash_node)
+		if (sock_tag_entry->sk == sk)
+			return sock_tag_entry;
+	return NULL;
 }
 
 static int ipx_proto(const struct sk_buff *skb,
@@ -1291,6 +1359,8 @@ static void iface_stat_update_from_skb(const struct sk_buff *skb,
 				       struct xt_action_param *par)
 {
 	struct iface_stat *entry;
+	struct iface_skb_totals_cpu __percpu *cpu_totals;
+	struct iface_skb_totals_cpu *itc;
 	const struct net_device *el_dev;
 	enum ifs_tx_rx direction = par->in ? IFS_RX : IFS_TX;
 	int bytes = skb->len;
@@ -1325,25 +1395,65 @@ static void iface_stat_update_from_skb(const struct sk_buff *skb,
 			 par->family, proto);
 	}
 
-	spin_lock_bh(&iface_stat_list_lock);
+	rcu_read_lock();
 	entry = get_iface_entry(el_dev->name);
 	if (entry == NULL) {
 		IF_DEBUG("qtaguid: iface_stat: %s(%s): not tracked\n",
 			 __func__, el_dev->name);
-		spin_unlock_bh(&iface_stat_list_lock);
+		rcu_read_unlock();
 		return;
 	}
 
 	IF_DEBUG("qtaguid: %s(%s): entry=%p\n", __func__,
 		 el_dev->name, entry);
 
-	entry->totals_via_skb[direction].bytes += bytes;
-	entry->totals_via_skb[direction].packets++;
-	spin_unlock_bh(&iface_stat_list_lock);
+	cpu_totals = rcu_dereference(entry->cpu_totals_via_skb);
+	if (likely(cpu_totals)) {
+		/* bh is off, so nobody else updates this cpu's copy */
+		itc = this_cpu_ptr(cpu_totals);
+		u64_stats_update_begin(&itc->syncp);
+		itc->totals[direction].bytes += bytes;
+		itc->totals[direction].packets++;
+		u64_stats_update_end(&itc->syncp);
+	} else {
+		spin_lock_bh(&iface_stat_list_lock);
+		entry->totals_via_skb[direction].bytes += bytes;
+		entry->totals_via_skb[direction].packets++;
+		spin_unlock_bh(&iface_stat_list_lock);
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * Add to a tag_stat's counters on the packet path, with bh disabled and
+ * under rcu_read_lock().
+ */
+static void tag_stat_add(struct iface_stat *iface_entry,
+			 struct tag_stat *ts, int set,
+			 enum ifs_tx_rx direction, int proto, int bytes)
+{
+	struct tag_stat_cpu __percpu *cpu_stats;
+	struct tag_stat_cpu *tsc;
+
+	cpu_stats = rcu_dereference(ts->cpu_stats);
+	if (likely(cpu_stats)) {
+		/* bh is off, so nobody else updates this cpu's copy */
+		tsc = this_cpu_ptr(cpu_stats);
+		u64_stats_update_begin(&tsc->syncp);
+		data_counters_update(&tsc->counters, set, direction, proto,
+				     bytes);
+		u64_stats_update_end(&tsc->syncp);
+		return;
+	}
+
+	spin_lock_bh(&iface_entry->tag_stat_list_lock);
+	data_counters_update(&ts->counters, set, direction, proto, bytes);
+	spin_unlock_bh(&iface_entry->tag_stat_list_lock);
 }
 
-static void tag_stat_update(struct tag_stat *tag_entry,
-			enum ifs_tx_rx direction, int proto, int bytes)
+static void tag_stat_update(struct iface_stat *iface_entry,
+			    struct tag_stat *tag_entry,
+			    enum ifs_tx_rx direction, int proto, int bytes)
 {
 	int active_set;
 	active_set = get_active_counter_set(tag_entry->tn.tag);
@@ -1351,11 +1461,42 @@ static void tag_stat_update(struct tag_stat *tag_entry,
 		 "dir=%d proto=%d bytes=%d)\n",
 		 tag_entry->tn.tag, get_uid_from_tag(tag_entry->tn.tag),
 		 active_set, direction, proto, bytes);
-	data_counters_update(&tag_entry->counters, active_set, direction,
-			     proto, bytes);
-	if (tag_entry->parent_counters)
-		data_counters_update(tag_entry->parent_counters, active_set,
-				     direction, proto, bytes);
+	tag_stat_add(iface_entry, tag_entry, active_set, direction, proto,
+		     bytes);
+	if (tag_entry->parent)
+		tag_stat_add(iface_entry, tag_entry->parent, active_set,
+			     direction, proto, bytes);
+}
+
+/*
+ * alloc_percpu() may sleep, so new tag_stats get their per-cpu counters
+ * from here rather than from the packet path.
+ */
+static void tag_stat_alloc_worker(struct work_struct *work)
+{
+	struct tag_stat_cpu __percpu *cpu_stats;
+	struct tag_stat *ts;
+
+	for (;;) {
+		cpu_stats = alloc_percpu(struct tag_stat_cpu);
+		if (!cpu_stats) {
+			/* The rest are retried when the next one is created */
+			pr_err("qtaguid: iface_stat: "
+			       "tag stat counters alloc failed\n");
+			return;
+		}
+		spin_lock_bh(&tag_stat_alloc_lock);
+		if (list_empty(&tag_stat_alloc_list)) {
+			spin_unlock_bh(&tag_stat_alloc_lock);
+			free_percpu(cpu_stats);
+			return;
+		}
+		ts = list_first_entry(&tag_stat_alloc_list, struct tag_stat,
+				      alloc_list);
+		list_del_init(&ts->alloc_list);
+		rcu_assign_pointer(ts->cpu_stats, cpu_stats);
+		spin_unlock_bh(&tag_stat_alloc_lock);
+	}
 }
 
 /*
@@ -1364,7 +1505,7 @@ static void tag_stat_update(struct tag_stat *tag_entry,
  * iface_entry->tag_stat_list_lock should be held.
  */
 static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
-					   tag_t tag)
+					   tag_t tag, struct tag_stat *parent)
 {
 	struct tag_stat *new_tag_stat_entry = NULL;
 	IF_DEBUG("qtaguid: iface_stat: %s(): ife=%p tag=0x%llx"
@@ -1376,32 +1517,61 @@ static struct tag_stat *create_if_tag_stat(struct iface_stat *iface_entry,
 		goto done;
 	}
 	new_tag_stat_entry->tn.tag = tag;
+	new_tag_stat_entry->parent = parent;
 	tag_stat_tree_insert(new_tag_stat_entry, &iface_entry->tag_stat_tree);
+	hlist_add_head_rcu(&new_tag_stat_entry->hash_node,
+			   &iface_entry->tag_stat_hash[hash_64(tag,
+							TAG_STAT_HASH_BITS)]);
+
+	spin_lock_bh(&tag_stat_alloc_lock);
+	list_add_tail(&new_tag_stat_entry->alloc_list, &tag_stat_alloc_list);
+	spin_unlock_bh(&tag_stat_alloc_lock);
+	schedule_work(&tag_stat_alloc_work);
 done:
 	return new_tag_stat_entry;
 }
 
-static void if_tag_stat_update(const char *ifname, uid_t uid,
+static void tag_stat_free_rcu(struct rcu_head *head)
+{
+	struct tag_stat *ts = container_of(head, struct tag_stat, rcu);
+
+	free_percpu(ts->cpu_stats);
+	kfree(ts);
+}
+
+/* iface_entry->tag_stat_list_lock should be held. */
+static void free_if_tag_stat(struct iface_stat *iface_entry,
+			     struct tag_stat *ts)
+{
+	rb_erase(&ts->tn.node, &iface_entry->tag_stat_tree);
+	hlist_del_rcu(&ts->hash_node);
+	spin_lock_bh(&tag_stat_alloc_lock);
+	list_del(&ts->alloc_list);
+	spin_unlock_bh(&tag_stat_alloc_lock);
+	call_rcu(&ts->rcu, tag_stat_free_rcu);
+}
+
+static void if_tag_stat_update(const struct net_device *dev, uid_t uid,
 			       const struct sock *sk, enum ifs_tx_rx direction,
 			       int proto, int bytes)
 {
+	const char *ifname = dev->name;
 	struct tag_stat *tag_stat_entry;
 	tag_t tag, acct_tag;
 	tag_t uid_tag;
-	struct data_counters *uid_tag_counters;
+	struct tag_stat *uid_tag_stat;
 	struct sock_tag *sock_tag_entry;
 	struct iface_stat *iface_entry;
-	struct tag_stat *new_tag_stat = NULL;
 	MT_DEBUG("qtaguid: if_tag_stat_update(ifname=%s "
 		"uid=%u sk=%p dir=%d proto=%d bytes=%d)\n",
 		 ifname, uid, sk, direction, proto, bytes);
 
-
+	rcu_read_lock();
 	iface_entry = get_iface_entry(ifname);
 	if (!iface_entry) {
 		pr_err("qtaguid: iface_stat: stat_update() %s not found\n",
 		       ifname);
-		return;
+		goto out;
 	}
 	/* It is ok to process data when an iface_entry is inactive */
 
@@ -1422,56 +1592,65 @@ static void if_tag_stat_update(const char *ifname, uid_t uid,
 		tag = combine_atag_with_uid(acct_tag, uid);
 		uid_tag = make_tag_from_uid(uid);
 	}
+	activity_stats_uid_update(get_uid_from_tag(uid_tag), dev,
+				  direction == IFS_RX ? ACTIVITY_STATS_RX :
+							ACTIVITY_STATS_TX);
 	MT_DEBUG("qtaguid: iface_stat: stat_update(): "
 		 " looking for tag=0x%llx (uid=%u) in ife=%p\n",
 		 tag, get_uid_from_tag(tag), iface_entry);
-	/* Loop over tag list under this interface for {acct_tag,uid_tag} */
-	spin_lock_bh(&iface_entry->tag_stat_list_lock);
+	/*
+	 * Look for {acct_tag,uid_tag} under this interface. Updating it
+	 * handles both stats: {0, uid_tag} will also get updated.
+	 */
+	tag_stat_entry = tag_stat_hash_search(iface_entry, tag);
+	if (tag_stat_entry)
+		goto update;
 
+	spin_lock_bh(&iface_entry->tag_stat_list_lock);
+	/* Somebody may have created it while we did not hold the lock */
 	tag_stat_entry = tag_stat_tree_search(&iface_entry->tag_stat_tree,
 					      tag);
-	if (tag_stat_entry) {
-		/*
-		 * Updating the {acct_tag, uid_tag} entry handles both stats:
-		 * {0, uid_tag} will also get updated.
-		 */
-		tag_stat_update(tag_stat_entry, direction, proto, bytes);
-		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
-		return;
-	}
+	if (tag_stat_entry)
+		goto unlock;
 
 	/* Loop over tag list under this interface for {0,uid_tag} */
-	tag_stat_entry = tag_stat_tree_search(&iface_entry->tag_stat_tree,
-					      uid_tag);
-	if (!tag_stat_entry) {
+	uid_tag_stat = tag_stat_tree_search(&iface_entry->tag_stat_tree,
+					    uid_tag);
+	if (!uid_tag_stat) {
 		/* Here: the base uid_tag did not exist */
 		/*
 		 * No parent counters. So
 		 *  - No {0, uid_tag} stats and no {acc_tag, uid_tag} stats.
 		 */
-		new_tag_stat = create_if_tag_stat(iface_entry, uid_tag);
-		uid_tag_counters = &new_tag_stat->counters;
-	} else {
-		uid_tag_counters = &tag_stat_entry->counters;
+		uid_tag_stat = create_if_tag_stat(iface_entry, uid_tag, NULL);
+		if (!uid_tag_stat)
+			goto unlock;
+		tag_stat_entry = uid_tag_stat;
 	}
 
 	if (acct_tag) {
 		/* Create the child {acct_tag, uid_tag} and hook up parent. */
-		new_tag_stat = create_if_tag_stat(iface_entry, tag);
-		new_tag_stat->parent_counters = uid_tag_counters;
+		tag_stat_entry = create_if_tag_stat(iface_entry, tag,
+						    uid_tag_stat);
 	} else {
 		/*
-		 * For new_tag_stat to be still NULL here would require:
+		 * For tag_stat_entry to be still NULL here would require:
 		 *  {0, uid_tag} exists
 		 *  and {acct_tag, uid_tag} doesn't exist
 		 *  AND acct_tag == 0.
-		 * Impossible. This reassures us that new_tag_stat
+		 * Impossible. This reassures us that tag_stat_entry
 		 * below will always be assigned.
 		 */
-		BUG_ON(!new_tag_stat);
+		BUG_ON(!tag_stat_entry);
 	}
-	tag_stat_update(new_tag_stat, direction, proto, bytes);
+unlock:
 	spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+	if (!tag_stat_entry)
+		goto out;
+update:
+	tag_stat_update(iface_entry, tag_stat_entry, direction, proto, bytes);
+out:
+	rcu_read_unlock();
 }
 
 static int iface_netdev_event_handler(struct notifier_block *nb,
@@ -1718,7 +1897,7 @@ static void account_for_uid(const struct sk_buff *skb,
 			 par->hooknum, el_dev->name, el_dev->type,
 			 par->family, proto);
 
-		if_tag_stat_update(el_dev->name, uid,
+		if_tag_stat_update(el_dev, uid,
 				skb->sk ? skb->sk : alternate_sk,
 				par->in ? IFS_RX : IFS_TX,
 				proto, skb->len);
@@ -2084,6 +2263,7 @@ static int ctrl_cmd_delete(const char *input)
 
 		if (!acct_tag || st_entry->tag == tag) {
 			rb_erase(&st_entry->sock_node, &sock_tag_tree);
+			hlist_del_rcu(&st_entry->hash_node);
 			/* Can't sockfd_put() within spinlock, do it later. */
 			sock_tag_tree_insert(st_entry, &st_to_free_tree);
 			tr_entry = lookup_tag_ref(st_entry->tag, NULL);
@@ -2116,7 +2296,8 @@ static int ctrl_cmd_delete(const char *input)
 			 get_uid_from_tag(tcs_entry->tn.tag),
 			 tcs_entry->active_set);
 		rb_erase(&tcs_entry->tn.node, &tag_counter_set_tree);
-		kfree(tcs_entry);
+		hlist_del_rcu(&tcs_entry->hash_node);
+		kfree_rcu(tcs_entry, rcu);
 	}
 	spin_unlock_bh(&tag_counter_set_list_lock);
 
@@ -2145,9 +2326,7 @@ static int ctrl_cmd_delete(const char *input)
 					 input, iface_entry->ifname,
 					 get_atag_from_tag(ts_entry->tn.tag),
 					 entry_uid);
-				rb_erase(&ts_entry->tn.node,
-					 &iface_entry->tag_stat_tree);
-				kfree(ts_entry);
+				free_if_tag_stat(iface_entry, ts_entry);
 			}
 		}
 		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
@@ -2230,6 +2409,8 @@ static int ctrl_cmd_counter_set(const char *input)
 		}
 		tcs->tn.tag = tag;
 		tag_counter_set_tree_insert(tcs, &tag_counter_set_tree);
+		hlist_add_head_rcu(&tcs->hash_node,
+				   tag_counter_set_hash_head(tag));
 		CT_DEBUG("qtaguid: ctrl_counterset(%s): added tcs tag=0x%llx "
 			 "(uid=%u) set=%d\n",
 			 input, tag, get_uid_from_tag(tag), counter_set);
@@ -2370,6 +2551,8 @@ static int ctrl_cmd_tag(const char *input)
 		spin_unlock_bh(&uid_tag_data_tree_lock);
 
 		sock_tag_tree_insert(sock_tag_entry, &sock_tag_tree);
+		hlist_add_head_rcu(&sock_tag_entry->hash_node,
+				   sock_tag_hash_head(sock_tag_entry->sk));
 		atomic64_inc(&qtu_events.sockets_tagged);
 	}
 	spin_unlock_bh(&sock_tag_list_lock);
@@ -2436,6 +2619,7 @@ static int ctrl_cmd_untag(const char *input)
 	 * so it can do whatever it wants to it.
 	 */
 	rb_erase(&sock_tag_entry->sock_node, &sock_tag_tree);
+	hlist_del_rcu(&sock_tag_entry->hash_node);
 
 	tag_ref_entry = lookup_tag_ref(sock_tag_entry->tag, &utd_entry);
 	BUG_ON(!tag_ref_entry);
@@ -2472,7 +2656,7 @@ static int ctrl_cmd_untag(const char *input)
 		 atomic_long_read(&el_socket->file->f_count) - 1);
 	sockfd_put(el_socket);
 
-	kfree(sock_tag_entry);
+	kfree_rcu(sock_tag_entry, rcu);
 	atomic64_inc(&qtu_events.sockets_untagged);
 
 	return 0;
@@ -2551,6 +2735,8 @@ struct proc_print_info {
 	char **num_items_returned;
 	struct iface_stat *iface_entry;
 	struct tag_stat *ts_entry;
+	/* ts_entry's per cpu counters, summed once for all the sets */
+	struct data_counters counters;
 	int item_index;
 	int items_to_skip;
 	int char_count;
@@ -2590,7 +2776,7 @@ static int pp_stats_line(struct proc_print_info *ppi, int cnt_set)
 		}
 		if (ppi->item_index++ < ppi->items_to_skip)
 			return 0;
-		cnts = &ppi->ts_entry->counters;
+		cnts = &ppi->counters;
 		len = snprintf(
 			ppi->outp, ppi->char_count,
 			"%d %s 0x%llx %u %u "
@@ -2705,6 +2891,7 @@ static int qtaguid_stats_proc_read(char *page, char **num_items_returned,
 		     node;
 		     node = rb_next(node)) {
 			ppi.ts_entry = rb_entry(node, struct tag_stat, tn.node);
+			tag_stat_sum_counters(ppi.ts_entry, &ppi.counters);
 			if (!pp_sets(&ppi)) {
 				spin_unlock_bh(
 					&ppi.iface_entry->tag_stat_list_lock);
@@ -2720,6 +2907,246 @@ static int qtaguid_stats_proc_read(char *page, char **num_items_returned,
 	return ppi.outp - page;
 }
 
+/*------------------------------------------*/
+/*
+ * Binary export of the stats file (see struct qtaguid_stats_hdr).
+ * A read at offset 0 takes a new snapshot. Once an fd has been read,
+ * later snapshots on it only carry the entries whose counters changed
+ * since its previous snapshot, flagged with QTAGUID_STATS_F_DELTA, plus
+ * the entries that went away, flagged with QTAGUID_STATS_ENTRY_F_DELETED.
+ */
+struct stats_bin_state {
+	struct mutex lock;
+	/* Last full snapshot, sorted, used to compute the next delta */
+	struct qtaguid_stats_entry *prev;
+	unsigned int nr_prev;
+	bool have_prev;
+	/* What read() hands out: header + entries */
+	char *buf;
+	size_t len;
+};
+
+static int stats_bin_entry_cmp(const void *a, const void *b)
+{
+	const struct qtaguid_stats_entry *ea = a, *eb = b;
+	int res;
+
+	res = strncmp(ea->iface, eb->iface, sizeof(ea->iface));
+	if (res)
+		return res;
+	if (ea->acct_tag != eb->acct_tag)
+		return ea->acct_tag < eb->acct_tag ? -1 : 1;
+	if (ea->uid != eb->uid)
+		return ea->uid < eb->uid ? -1 : 1;
+	if (ea->cnt_set != eb->cnt_set)
+		return ea->cnt_set < eb->cnt_set ? -1 : 1;
+	return 0;
+}
+
+static void stats_bin_fill(struct qtaguid_stats_entry *ent,
+			   const struct iface_stat *iface_entry, tag_t tag,
+			   int cnt_set, const struct data_counters *cnts)
+{
+	static const enum ifs_proto protos[QTAGUID_PROTO_MAX] = {
+		[QTAGUID_PROTO_TCP] = IFS_TCP,
+		[QTAGUID_PROTO_UDP] = IFS_UDP,
+		[QTAGUID_PROTO_OTHER] = IFS_PROTO_OTHER,
+	};
+	int i;
+
+	memset(ent, 0, sizeof(*ent));
+	strlcpy(ent->iface, iface_entry->ifname, sizeof(ent->iface));
+	ent->acct_tag = get_atag_from_tag(tag);
+	ent->uid = get_uid_from_tag(tag);
+	ent->cnt_set = cnt_set;
+	for (i = 0; i < QTAGUID_PROTO_MAX; i++) {
+		const struct byte_packet_counters *rx, *tx;
+
+		rx = &cnts->bpc[cnt_set][IFS_RX][protos[i]];
+		tx = &cnts->bpc[cnt_set][IFS_TX][protos[i]];
+		ent->rx_bytes[i] = rx->bytes;
+		ent->rx_packets[i] = rx->packets;
+		ent->tx_bytes[i] = tx->bytes;
+		ent->tx_packets[i] = tx->packets;
+	}
+}
+
+/*
+ * Returns a vmalloc()ed, sorted array of all the entries the caller may
+ * see, or an ERR_PTR. *nr is set to the number of entries.
+ */
+static struct qtaguid_stats_entry *stats_bin_snapshot(unsigned int *nr)
+{
+	struct qtaguid_stats_entry *entries;
+	struct iface_stat *iface_entry;
+	struct data_counters cnts;
+	struct rb_node *node;
+	unsigned int max = 0, n = 0;
+	int cnt_set;
+
+	*nr = 0;
+	if (unlikely(module_passive))
+		return NULL;
+
+	spin_lock_bh(&iface_stat_list_lock);
+	list_for_each_entry(iface_entry, &iface_stat_list, list) {
+		spin_lock_bh(&iface_entry->tag_stat_list_lock);
+		for (node = rb_first(&iface_entry->tag_stat_tree);
+		     node;
+		     node = rb_next(node))
+			max += IFS_MAX_COUNTER_SETS;
+		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+	}
+	spin_unlock_bh(&iface_stat_list_lock);
+
+	if (!max)
+		return NULL;
+	entries = vmalloc(max * sizeof(*entries));
+	if (!entries)
+		return ERR_PTR(-ENOMEM);
+
+	/* Entries created since we counted are left for the next read */
+	spin_lock_bh(&iface_stat_list_lock);
+	list_for_each_entry(iface_entry, &iface_stat_list, list) {
+		spin_lock_bh(&iface_entry->tag_stat_list_lock);
+		for (node = rb_first(&iface_entry->tag_stat_tree);
+		     node && n < max;
+		     node = rb_next(node)) {
+			struct tag_stat *ts_entry;
+			tag_t tag;
+
+			ts_entry = rb_entry(node, struct tag_stat, tn.node);
+			tag = ts_entry->tn.tag;
+			/* Detailed tags are not available to everybody */
+			if (get_atag_from_tag(tag) &&
+			    !can_read_other_uid_stats(get_uid_from_tag(tag)))
+				continue;
+			tag_stat_sum_counters(ts_entry, &cnts);
+			for (cnt_set = 0; cnt_set < IFS_MAX_COUNTER_SETS;
+			     cnt_set++)
+				stats_bin_fill(&entries[n++], iface_entry, tag,
+					       cnt_set, &cnts);
+		}
+		spin_unlock_bh(&iface_entry->tag_stat_list_lock);
+	}
+	spin_unlock_bh(&iface_stat_list_lock);
+
+	sort(entries, n, sizeof(*entries), stats_bin_entry_cmp, NULL);
+	*nr = n;
+	return entries;
+}
+
+static int stats_bin_refresh(struct stats_bin_state *st)
+{
+	struct qtaguid_stats_entry *cur, *out;
+	struct qtaguid_stats_hdr *hdr;
+	unsigned int nr_cur, nr_prev, nr_out = 0, i = 0, j = 0;
+	char *buf;
+	int cmp;
+
+	cur = stats_bin_snapshot(&nr_cur);
+	if (IS_ERR(cur))
+		return PTR_ERR(cur);
+
+	nr_prev = st->have_prev ? st->nr_prev : 0;
+	buf = vmalloc(sizeof(*hdr) + (nr_cur + nr_prev) * sizeof(*cur));
+	if (!buf) {
+		vfree(cur);
+		return -ENOMEM;
+	}
+	hdr = (struct qtaguid_stats_hdr *)buf;
+	out = (struct qtaguid_stats_entry *)(hdr + 1);
+
+	/* Both arrays are sorted: walk them in step */
+	while (i < nr_cur || j < nr_prev) {
+		if (j >= nr_prev)
+			cmp = 1;
+		else if (i >= nr_cur)
+			cmp = -1;
+		else
+			cmp = stats_bin_entry_cmp(&st->prev[j], &cur[i]);
+
+		if (cmp < 0) {
+			/* Gone since the previous snapshot */
+			out[nr_out] = st->prev[j++];
+			out[nr_out++].flags = QTAGUID_STATS_ENTRY_F_DELETED;
+			continue;
+		}
+		if (cmp == 0 && !memcmp(&st->prev[j++], &cur[i], sizeof(*cur))) {
+			i++;
+			continue;
+		}
+		out[nr_out++] = cur[i++];
+	}
+
+	memset(hdr, 0, sizeof(*hdr));
+	hdr->magic = QTAGUID_STATS_MAGIC;
+	hdr->version = QTAGUID_STATS_VERSION;
+	hdr->hdr_size = sizeof(*hdr);
+	hdr->entry_size = sizeof(*cur);
+	hdr->nr_entries = nr_out;
+	if (st->have_prev)
+		hdr->flags |= QTAGUID_STATS_F_DELTA;
+
+	vfree(st->buf);
+	st->buf = buf;
+	st->len = sizeof(*hdr) + nr_out * sizeof(*cur);
+	vfree(st->prev);
+	st->prev = cur;
+	st->nr_prev = nr_cur;
+	st->have_prev = true;
+	return 0;
+}
+
+static int qtaguid_stats_bin_open(struct inode *inode, struct file *file)
+{
+	struct stats_bin_state *st;
+
+	st = kzalloc(sizeof(*st), GFP_KERNEL);
+	if (!st)
+		return -ENOMEM;
+	mutex_init(&st->lock);
+	file->private_data = st;
+	return 0;
+}
+
+static ssize_t qtaguid_stats_bin_read(struct file *file, char __user *ubuf,
+				      size_t count, loff_t *ppos)
+{
+	struct stats_bin_state *st = file->private_data;
+	ssize_t res;
+
+	mutex_lock(&st->lock);
+	if (*ppos == 0) {
+		res = stats_bin_refresh(st);
+		if (res) {
+			mutex_unlock(&st->lock);
+			return res;
+		}
+	}
+	res = simple_read_from_buffer(ubuf, count, ppos, st->buf, st->len);
+	mutex_unlock(&st->lock);
+	return res;
+}
+
+static int qtaguid_stats_bin_release(struct inode *inode, struct file *file)
+{
+	struct stats_bin_state *st = file->private_data;
+
+	vfree(st->buf);
+	vfree(st->prev);
+	kfree(st);
+	return 0;
+}
+
+static const struct file_operations qtaguid_stats_bin_fops = {
+	.owner = THIS_MODULE,
+	.open = qtaguid_stats_bin_open,
+	.read = qtaguid_stats_bin_read,
+	.llseek = default_llseek,
+	.release = qtaguid_stats_bin_release,
+};
+
 /*------------------------------------------*/
 static int qtudev_open(struct inode *inode, struct file *file)
 {
@@ -2838,6 +3265,7 @@ static int qtudev_release(struct inode *inode, struct file *file)
 		free_tag_ref_from_utd_entry(tr, utd_entry);
 
 		rb_erase(&st_entry->sock_node, &sock_tag_tree);
+		hlist_del_rcu(&st_entry->hash_node);
 		list_del(&st_entry->list);
 		/* Can't sockfd_put() within spinlock, do it later. */
 		sock_tag_tree_insert(st_entry, &st_to_free_tree);
@@ -2917,8 +3345,20 @@ static int __init qtaguid_proc_register(struct proc_dir_entry **res_procdir)
 	 * TODO: add support counter hacking
 	 * xt_qtaguid_stats_file->write_proc = qtaguid_stats_proc_write;
 	 */
+
+	xt_qtaguid_stats_bin_file = proc_create("stats_bin", proc_stats_perms,
+						*res_procdir,
+						&qtaguid_stats_bin_fops);
+	if (!xt_qtaguid_stats_bin_file) {
+		pr_err("qtaguid: failed to create xt_qtaguid/stats_bin "
+			"file\n");
+		ret = -ENOMEM;
+		goto no_stats_bin_entry;
+	}
 	return 0;
 
+no_stats_bin_entry:
+	remove_proc_entry("stats", *res_procdir);
 no_stats_entry:
 	remove_proc_entry("ctrl", *res_procdir);
 no_ctrl_entry:
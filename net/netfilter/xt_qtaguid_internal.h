@@ -11,8 +11,14 @@
 #define __XT_QTAGUID_INTERNAL_H__
 
 #include <linux/types.h>
+#include <linux/cpumask.h>
+#include <linux/list.h>
+#include <linux/percpu.h>
 #include <linux/rbtree.h>
+#include <linux/rcupdate.h>
 #include <linux/spinlock_types.h>
+#include <linux/string.h>
+#include <linux/u64_stats_sync.h>
 #include <linux/workqueue.h>
 
 /* Iface handling */
@@ -185,14 +191,41 @@ struct tag_node {
 	tag_t tag;
 };
 
+/*
+ * Per cpu counters. The packet path only adds to its own cpu's copy;
+ * syncp keeps readers from seeing torn u64s on 32-bit.
+ */
+struct tag_stat_cpu {
+	struct data_counters counters;
+	struct u64_stats_sync syncp;
+};
+
+struct iface_skb_totals_cpu {
+	struct byte_packet_counters totals[IFS_MAX_DIRECTIONS];
+	struct u64_stats_sync syncp;
+};
+
+#define TAG_STAT_HASH_BITS 6
+#define TAG_STAT_HASH_SIZE (1 << TAG_STAT_HASH_BITS)
+
 struct tag_stat {
 	struct tag_node tn;
+	/* In iface_stat.tag_stat_hash, looked up under RCU */
+	struct hlist_node hash_node;
+	/*
+	 * alloc_percpu() can sleep, so cpu_stats is attached later by a
+	 * worker. Until then the packet path adds to counters under the
+	 * iface's tag_stat_list_lock. Readers sum both.
+	 */
+	struct tag_stat_cpu __percpu *cpu_stats;
 	struct data_counters counters;
+	struct list_head alloc_list;	/* Waiting for cpu_stats */
 	/*
 	 * If this tag is acct_tag based, we need to count against the
 	 * matching parent uid_tag.
 	 */
-	struct data_counters *parent_counters;
+	struct tag_stat *parent;
+	struct rcu_head rcu;
 };
 
 struct iface_stat {
@@ -203,7 +236,12 @@ struct iface_stat {
 	struct net_device *net_dev;
 
 	struct byte_packet_counters totals_via_dev[IFS_MAX_DIRECTIONS];
+	/*
+	 * Like tag_stat: totals_via_skb is updated under iface_stat_list_lock
+	 * until iface_create_proc_worker() attaches cpu_totals_via_skb.
+	 */
 	struct byte_packet_counters totals_via_skb[IFS_MAX_DIRECTIONS];
+	struct iface_skb_totals_cpu __percpu *cpu_totals_via_skb;
 	/*
 	 * We keep the last_known, because some devices reset their counters
 	 * just before NETDEV_UP, while some will reset just before
@@ -219,9 +257,72 @@ struct iface_stat {
 	struct proc_dir_entry *proc_ptr;
 
 	struct rb_root tag_stat_tree;
+	struct hlist_head tag_stat_hash[TAG_STAT_HASH_SIZE];
 	spinlock_t tag_stat_list_lock;
 };
 
+/* Caller must hold the iface's tag_stat_list_lock */
+static inline void tag_stat_sum_counters(const struct tag_stat *ts,
+					 struct data_counters *sum)
+{
+	const struct tag_stat_cpu __percpu *cpu_stats;
+	int cpu, set, dir, proto;
+
+	*sum = ts->counters;
+	cpu_stats = rcu_dereference_raw(ts->cpu_stats);
+	if (!cpu_stats)
+		return;
+	for_each_possible_cpu(cpu) {
+		const struct tag_stat_cpu *tsc = per_cpu_ptr(cpu_stats, cpu);
+		struct data_counters dc;
+		unsigned int start;
+
+		do {
+			start = u64_stats_fetch_begin_bh(&tsc->syncp);
+			dc = tsc->counters;
+		} while (u64_stats_fetch_retry_bh(&tsc->syncp, start));
+
+		for (set = 0; set < IFS_MAX_COUNTER_SETS; set++)
+			for (dir = 0; dir < IFS_MAX_DIRECTIONS; dir++)
+				for (proto = 0; proto < IFS_MAX_PROTOS; proto++) {
+					sum->bpc[set][dir][proto].bytes +=
+						dc.bpc[set][dir][proto].bytes;
+					sum->bpc[set][dir][proto].packets +=
+						dc.bpc[set][dir][proto].packets;
+				}
+	}
+}
+
+/* Caller must hold iface_stat_list_lock */
+static inline void iface_sum_skb_totals(const struct iface_stat *is,
+				struct byte_packet_counters *totals)
+{
+	const struct iface_skb_totals_cpu __percpu *cpu_totals;
+	int cpu, dir;
+
+	memcpy(totals, is->totals_via_skb,
+	       sizeof(*totals) * IFS_MAX_DIRECTIONS);
+	cpu_totals = rcu_dereference_raw(is->cpu_totals_via_skb);
+	if (!cpu_totals)
+		return;
+	for_each_possible_cpu(cpu) {
+		const struct iface_skb_totals_cpu *itc =
+			per_cpu_ptr(cpu_totals, cpu);
+		struct byte_packet_counters t[IFS_MAX_DIRECTIONS];
+		unsigned int start;
+
+		do {
+			start = u64_stats_fetch_begin_bh(&itc->syncp);
+			memcpy(t, itc->totals, sizeof(t));
+		} while (u64_stats_fetch_retry_bh(&itc->syncp, start));
+
+		for (dir = 0; dir < IFS_MAX_DIRECTIONS; dir++) {
+			totals[dir].bytes += t[dir].bytes;
+			totals[dir].packets += t[dir].packets;
+		}
+	}
+}
+
 /* This is needed to create proc_dir_entries from atomic context. */
 struct iface_stat_work {
 	struct work_struct iface_work;
@@ -236,6 +337,8 @@ struct iface_stat_work {
  */
 struct sock_tag {
 	struct rb_node sock_node;
+	/* In sock_tag_hash, for the lookup on the packet path under RCU */
+	struct hlist_node hash_node;
 	struct sock *sk;  /* Only used as a number, never dereferenced */
 	/* The socket is needed for sockfd_put() */
 	struct socket *socket;
@@ -244,6 +347,7 @@ struct sock_tag {
 	pid_t pid;
 
 	tag_t tag;
+	struct rcu_head rcu;
 };
 
 struct qtaguid_event_counts {
@@ -281,7 +385,9 @@ struct qtaguid_event_counts {
 /* Track the set active_set for the given tag. */
 struct tag_counter_set {
 	struct tag_node tn;
+	struct hlist_node hash_node;	/* In tag_counter_set_hash */
 	int active_set;
+	struct rcu_head rcu;
 };
 
 /*----------------------------------------------*/